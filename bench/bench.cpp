@@ -0,0 +1,505 @@
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <thread>
+#include <tpr/alignment.hpp>
+#include <tpr/dictionary.hpp>
+#include <tpr/export.hpp>
+#include <tpr/generator.hpp>
+#include <tpr/length_index.hpp>
+#include <tpr/random.hpp>
+#include <tpr/render.hpp>
+#include <tpr/session_log.hpp>
+#include <vector>
+
+#include "harness.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Writes `words` pseudo words, one per line, always the same for a seed.
+// Lengths follow a rough english distribution peaking at 5 to 7 letters
+// and letters are skewed toward the frequent ones, so the files look like
+// frequency lists to the loader and the length index.
+auto write_synthetic_dictionary(const fs::path& path, uint64_t words,
+                                uint64_t seed = 1) -> bool {
+    constexpr std::string_view letters = "etaoinshrdlcumwfgypbvkjxqz";
+
+    std::FILE* file = std::fopen(path.string().c_str(), "wb");
+
+    if (not file) {
+        return false;
+    }
+
+    tpr::Xoshiro256 engine(seed);
+    std::binomial_distribution<unsigned> length(16, 0.38);
+    std::geometric_distribution<std::size_t> letter(0.12);
+
+    std::string buffer;
+    buffer.reserve(1 << 16);
+
+    bool written = true;
+
+    for (uint64_t i = 0; i < words and written; ++i) {
+        const auto size = std::max(length(engine), 1u);
+
+        for (unsigned j = 0; j < size; ++j) {
+            buffer.push_back(letters[letter(engine) % letters.size()]);
+        }
+
+        buffer.push_back('\n');
+
+        if (buffer.size() >= (1 << 16) - 32 or i + 1 == words) {
+            written = std::fwrite(buffer.data(), 1, buffer.size(), file) ==
+                      buffer.size();
+            buffer.clear();
+        }
+    }
+
+    return std::fclose(file) == 0 and written;
+}
+
+// Synthetic dictionary of `words` lines in `directory`, generated once.
+auto synthetic_dictionary(const fs::path& directory, uint64_t words)
+    -> fs::path {
+    const auto path = directory / fmt::format("synthetic-{}.txt", words);
+
+    if (not fs::exists(path) and not write_synthetic_dictionary(path, words)) {
+        throw std::runtime_error(
+            fmt::format("could not write \"{}\"", path.string()));
+    }
+
+    return path;
+}
+
+// Typed version of `target` with about one typo every `every` characters:
+// substituted, dropped or doubled characters.
+auto with_typos(std::string_view target, std::size_t every, uint64_t seed)
+    -> std::string {
+    tpr::Xoshiro256 engine(seed);
+    std::uniform_int_distribution<std::size_t> chance(0, every - 1);
+    std::uniform_int_distribution<int> kind(0, 2);
+
+    std::string typed;
+    typed.reserve(target.size() + target.size() / every + 1);
+
+    for (const auto c : target) {
+        if (chance(engine)) {
+            typed.push_back(c);
+            continue;
+        }
+
+        switch (kind(engine)) {
+            case 0:
+                typed.push_back(c == 'x' ? 'y' : 'x');
+                break;
+            case 1:
+                break;
+            default:
+                typed.push_back(c);
+                typed.push_back(c);
+        }
+    }
+
+    return typed;
+}
+
+struct Options {
+    std::chrono::nanoseconds budget;
+    bool quick = false;
+    unsigned threads = 1;
+    fs::path directory;
+    fs::path dictionary;
+};
+
+auto load_benchmarks(const Options& options, std::vector<bench::Result>& out)
+    -> void {
+    std::vector<std::pair<std::string, fs::path>> inputs{
+        {"20k", options.dictionary},
+        {"1M", synthetic_dictionary(options.directory, 1'000'000)},
+    };
+
+    if (not options.quick) {
+        inputs.emplace_back(
+            "10M", synthetic_dictionary(options.directory, 10'000'000));
+    }
+
+    for (const auto& [name, path] : inputs) {
+        const auto bytes = fs::file_size(path);
+
+        out.push_back(bench::measure(
+            fmt::format("read_dictionary/text/{}", name), options.budget,
+            bytes, [&] {
+                bench::keep(tpr::read_dictionary<char>(
+                    path, std::pmr::get_default_resource()));
+            }));
+
+        out.push_back(bench::measure(
+            fmt::format("read_dictionary/text/{}/top=200", name),
+            options.budget, 200, [&] {
+                bench::keep(tpr::read_dictionary<char>(
+                    path, std::pmr::get_default_resource(), 1, 200));
+            }));
+
+        if (options.threads > 1) {
+            out.push_back(bench::measure(
+                fmt::format("read_dictionary/text/{}/threads={}", name,
+                            options.threads),
+                options.budget, bytes, [&] {
+                    bench::keep(tpr::read_dictionary<char>(
+                        path, std::pmr::get_default_resource(),
+                        options.threads));
+                }));
+        }
+
+        auto compiled = options.directory / fmt::format("{}.tpd", name);
+
+        if (const auto dictionary = tpr::read_dictionary<char>(
+                path, std::pmr::get_default_resource());
+            not dictionary or
+            not tpr::compile_dictionary(*dictionary, compiled)) {
+            throw std::runtime_error(
+                fmt::format("could not compile \"{}\"", path.string()));
+        }
+
+        out.push_back(bench::measure(
+            fmt::format("read_dictionary/tpd/{}", name), options.budget,
+            fs::file_size(compiled), [&] {
+                bench::keep(tpr::read_dictionary<char>(
+                    compiled, std::pmr::get_default_resource()));
+            }));
+
+        const auto dictionary = tpr::read_dictionary<char>(
+            compiled, std::pmr::get_default_resource());
+
+        out.push_back(bench::measure(
+            fmt::format("length_index/{}", name), options.budget,
+            dictionary->size(),
+            [&] { bench::keep(tpr::LengthIndex(*dictionary)); }));
+    }
+}
+
+auto generate_benchmarks(const Options& options,
+                         std::vector<bench::Result>& out) -> void {
+    auto dictionary = tpr::read_dictionary<char>(
+        options.dictionary, std::pmr::get_default_resource());
+
+    const tpr::TestGenerator<char> generator(std::move(*dictionary), 1);
+
+    std::vector<std::byte> storage(64 * 1024);
+    std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size());
+    tpr::Xoshiro256 engine(1);
+
+    for (const uint64_t top : {200, 1000, 20000}) {
+        for (const uint64_t amount : {25, 100}) {
+            for (const bool weighted : {false, true}) {
+                const tpr::TestConfig config{
+                    .amount = amount,
+                    .top = top,
+                    .weighted = weighted,
+                };
+
+                out.push_back(bench::measure(
+                    fmt::format("generate/{}/top={}/amount={}",
+                                weighted ? "zipf" : "uniform", top, amount),
+                    options.budget, amount, [&] {
+                        bench::keep(generator.generate(config, engine, &arena));
+                        arena.release();
+                    }));
+            }
+        }
+    }
+
+    for (const uint64_t amount : {25, 100}) {
+        std::pmr::vector<uint32_t> words;
+        tpr::floyd_sample(1000, amount, engine, words);
+
+        out.push_back(bench::measure(
+            fmt::format("assemble_test/amount={}", amount), options.budget,
+            amount, [&] {
+                bench::keep(tpr::assemble_test(generator.dictionary(), words,
+                                               &arena));
+                arena.release();
+            }));
+    }
+}
+
+auto score_benchmarks(const Options& options, std::vector<bench::Result>& out)
+    -> void {
+    auto dictionary = tpr::read_dictionary<char>(
+        options.dictionary, std::pmr::get_default_resource());
+
+    tpr::TestGenerator<char> generator(std::move(*dictionary), 2);
+
+    std::vector<std::byte> storage(256 * 1024);
+    std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size());
+
+    for (const uint64_t amount : {25, 100}) {
+        const auto target = generator.generate({.amount = amount, .top = 1000});
+
+        for (const std::size_t every : {1000, 30, 8}) {
+            const auto typed = with_typos(target, every, amount + every);
+            const std::string_view t(target);
+            const std::string_view y(typed);
+
+            const auto name = [&](std::string_view what) {
+                return fmt::format("{}/amount={}/typo_every={}", what, amount,
+                                   every);
+            };
+
+            out.push_back(bench::measure(
+                name("align_text"), options.budget, target.size(), [&] {
+                    bench::keep(tpr::align_text(t, y, &arena));
+                    arena.release();
+                }));
+
+            out.push_back(bench::measure(
+                name("score"), options.budget, target.size(), [&] {
+                    bench::keep(tpr::score(t, y, &arena));
+                    arena.release();
+                }));
+
+            fmt::memory_buffer rendered;
+
+            out.push_back(bench::measure(
+                name("render_errors"), options.budget, target.size(), [&] {
+                    rendered.clear();
+                    bench::keep(tpr::render_errors(t, y, rendered, &arena));
+                    arena.release();
+                }));
+        }
+    }
+}
+
+// Session log of `sessions` tests of `amount` words typed with a typo
+// every 30 characters, keystrokes 150ms apart, generated once.
+auto synthetic_log(const fs::path& directory,
+                   const tpr::TestGenerator<char>& generator,
+                   uint64_t sessions, uint64_t amount) -> fs::path {
+    const auto path = directory / fmt::format("synthetic-{}.tpl", sessions);
+
+    if (fs::exists(path)) {
+        return path;
+    }
+
+    auto log = tpr::SessionLog::open(path, 0);
+    tpr::Xoshiro256 engine(3);
+    bool written = log.has_value();
+
+    for (uint64_t i = 0; i < sessions and written; ++i) {
+        const auto text =
+            generator.generate({.amount = amount, .top = 1000}, engine, {});
+        const auto typed = with_typos(text, 30, i);
+
+        tpr::KeystrokeBuffer keystrokes(typed.size() + 1);
+
+        for (std::size_t j = 0; j <= typed.size(); ++j) {
+            keystrokes.push({j * 150'000'000,
+                             j < typed.size() ? typed[j] : tpr::key_enter});
+        }
+
+        written = log->append({
+            .seed = i,
+            .time = static_cast<int64_t>(i),
+            .text = text,
+            .typed = typed,
+            .keystrokes = &keystrokes,
+        });
+    }
+
+    if (not written or not log->flush()) {
+        throw std::runtime_error(
+            fmt::format("could not write \"{}\"", path.string()));
+    }
+
+    return path;
+}
+
+auto export_benchmarks(const Options& options,
+                       std::vector<bench::Result>& out) -> void {
+    auto dictionary = tpr::read_dictionary<char>(
+        options.dictionary, std::pmr::get_default_resource());
+
+    const tpr::TestGenerator<char> generator(std::move(*dictionary), 4);
+
+    const auto log_path =
+        synthetic_log(options.directory, generator, 16 * 1024, 50);
+    const auto log = tpr::MappedFile::open(log_path);
+
+    // a typical result, formatted over and over
+    tpr::LoggedSession session;
+    tpr::LogReader reader(log->bytes());
+    reader.next(session);
+
+    std::pmr::vector<uint64_t> words;
+    tpr::word_times(session, session.header.keystrokes, words);
+
+    const tpr::TestResult result{
+        .seed = session.header.seed,
+        .time = session.header.time,
+        .characters = session.typed.size(),
+        .duration = session.duration(),
+        .score = tpr::score(session.text, session.typed),
+        .words = words,
+    };
+
+    fmt::memory_buffer buffer;
+    const auto output_path = options.directory / "export.out";
+
+    std::FILE* file = std::fopen(output_path.string().c_str(), "wb");
+
+    if (not file) {
+        throw std::runtime_error(
+            fmt::format("could not open \"{}\"", output_path.string()));
+    }
+
+    for (const auto format : {tpr::ExportFormat::jsonl,
+                              tpr::ExportFormat::csv}) {
+        const auto name = format == tpr::ExportFormat::jsonl ? "jsonl" : "csv";
+
+        out.push_back(bench::measure(
+            fmt::format("export/{}/append_result", name), options.budget, 1,
+            [&] {
+                if (buffer.size() >= (1 << 20)) {
+                    buffer.clear();
+                }
+
+                tpr::append_result(result, format, buffer);
+            }));
+
+        const auto export_log = [&](unsigned threads) {
+            out.push_back(bench::measure(
+                fmt::format("export/{}/sessions/threads={}", name, threads),
+                options.budget, 16 * 1024, [&] {
+                    std::rewind(file);
+                    bench::keep(
+                        tpr::export_sessions(*log, threads, format, file));
+                }));
+        };
+
+        export_log(1);
+
+        if (options.threads > 1) {
+            export_log(options.threads);
+        }
+    }
+
+    std::fclose(file);
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    argparse::ArgumentParser program("typer_bench", "0.0.1");
+
+    program.add_description(
+        "Benchmark loading, generating and scoring typing tests");
+
+    program.add_argument("--json", "-o")
+        .help("write results as json to this file, '-' for stdout");
+
+    program.add_argument("--budget")
+        .help("milliseconds spent on every benchmark")
+        .scan<'u', unsigned>()
+        .default_value(200u);
+
+    program.add_argument("--quick")
+        .help("skip the 10M word inputs")
+        .flag();
+
+    program.add_argument("--threads", "-j")
+        .help("threads for parallel dictionary parsing")
+        .scan<'u', unsigned>()
+        .default_value(std::max(std::thread::hardware_concurrency(), 1u));
+
+    program.add_argument("--work-dir")
+        .help("directory for the synthetic dictionaries")
+        .default_value((fs::temp_directory_path() / "typer_bench").string());
+
+    program.add_argument("--dictionary", "-d")
+        .help("dictionary of the 20k, generation and scoring benchmarks")
+        .default_value("res/20k.txt");
+
+    program.add_argument("--generate")
+        .help(
+            "only write a synthetic dictionary, usage: --generate words "
+            "out.txt")
+        .nargs(2);
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::exception& err) {
+        fmt::print(stderr, "{}\n", err.what());
+        std::cerr << program;
+        return 1;
+    }
+
+    if (const auto arguments =
+            program.present<std::vector<std::string>>("--generate")) {
+        return write_synthetic_dictionary((*arguments)[1],
+                                          std::stoull((*arguments)[0]))
+                   ? 0
+                   : 1;
+    }
+
+    Options options{
+        .budget = std::chrono::milliseconds(program.get<unsigned>("--budget")),
+        .quick = program.get<bool>("--quick"),
+        .threads = program.get<unsigned>("--threads"),
+        .directory = program.get("--work-dir"),
+        .dictionary = program.get("--dictionary"),
+    };
+
+    std::vector<bench::Result> results;
+
+    try {
+        fs::create_directories(options.directory);
+
+        if (not fs::exists(options.dictionary)) {
+            options.dictionary =
+                synthetic_dictionary(options.directory, 20'000);
+        }
+
+        load_benchmarks(options, results);
+        generate_benchmarks(options, results);
+        score_benchmarks(options, results);
+        export_benchmarks(options, results);
+    } catch (const std::exception& err) {
+        fmt::print(stderr, "Error occured: {}\n", err.what());
+        return 1;
+    }
+
+    const auto json = program.present("--json");
+
+    if (not json) {
+        return bench::write_table(results, stdout) ? 0 : 1;
+    }
+
+    std::FILE* file =
+        *json == "-" ? stdout : std::fopen(json->c_str(), "wb");
+
+    if (not file) {
+        fmt::print(stderr, "Error occured: Could not open file \"{}\"\n",
+                   *json);
+        return 1;
+    }
+
+    const bool written = bench::write_json(results, "0.0.1", file);
+
+    if (file != stdout) {
+        std::fclose(file);
+    }
+
+    return written ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench {
+
+// Keeps the compiler from optimizing away a value that is never used.
+template <class T>
+inline auto keep(const T& value) noexcept -> void {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+struct Result {
+    std::string name;
+    uint64_t iterations = 0;
+    double mean = 0.0;  // nanoseconds per iteration
+    double best = 0.0;  // nanoseconds per iteration of the fastest round
+    uint64_t items = 0;  // processed per iteration, e.g. words or bytes
+};
+
+// Runs `iteration()` in rounds of doubling size until `budget` is spent,
+// at least once. The fastest round is reported next to the mean since it
+// is the least disturbed by the rest of the system.
+template <class Iteration>
+auto measure(std::string name, std::chrono::nanoseconds budget,
+             uint64_t items, Iteration&& iteration) -> Result {
+    namespace chr = std::chrono;
+
+    Result result{.name = std::move(name), .items = items};
+
+    chr::nanoseconds spent{};
+    double best = 0.0;
+
+    for (uint64_t round = 1; spent < budget or result.iterations == 0;
+         round = std::min<uint64_t>(round * 2, 1 << 20)) {
+        const auto start = chr::steady_clock::now();
+
+        for (uint64_t i = 0; i < round; ++i) {
+            iteration();
+        }
+
+        const auto elapsed = chr::steady_clock::now() - start;
+        const auto per_iteration =
+            static_cast<double>(chr::nanoseconds(elapsed).count()) /
+            static_cast<double>(round);
+
+        best = result.iterations ? std::min(best, per_iteration)
+                                 : per_iteration;
+        spent += elapsed;
+        result.iterations += round;
+    }
+
+    result.mean = static_cast<double>(spent.count()) /
+                  static_cast<double>(result.iterations);
+    result.best = best;
+
+    return result;
+}
+
+// Machine readable report, one object per benchmark, so results of two
+// versions can be diffed by name.
+inline auto write_json(const std::vector<Result>& results,
+                       std::string_view version, std::FILE* file) -> bool {
+    fmt::memory_buffer out;
+    const auto to = std::back_inserter(out);
+
+    fmt::format_to(to, "{{\n  \"version\": \"{}\",\n  \"benchmarks\": [", version);
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+
+        fmt::format_to(to,
+                       "{}\n    {{\"name\": \"{}\", \"iterations\": {}, "
+                       "\"mean_ns\": {:.1f}, \"best_ns\": {:.1f}, "
+                       "\"items\": {}, \"items_per_second\": {:.1f}}}",
+                       i ? "," : "", result.name, result.iterations,
+                       result.mean, result.best, result.items,
+                       result.mean > 0.0 ? result.items * 1e9 / result.mean
+                                         : 0.0);
+    }
+
+    fmt::format_to(to, "\n  ]\n}}\n");
+
+    return std::fwrite(out.data(), 1, out.size(), file) == out.size() and
+           std::fflush(file) == 0;
+}
+
+inline auto write_table(const std::vector<Result>& results, std::FILE* file)
+    -> bool {
+    fmt::memory_buffer out;
+    const auto to = std::back_inserter(out);
+
+    std::size_t width = 9;
+
+    for (const auto& result : results) {
+        width = std::max(width, result.name.size());
+    }
+
+    fmt::format_to(to, "{:<{}} {:>12} {:>14} {:>14} {:>14}\n", "benchmark",
+                   width, "iterations", "mean", "best", "items/s");
+
+    for (const auto& result : results) {
+        fmt::format_to(to, "{:<{}} {:>12} {:>11.1f} ns {:>11.1f} ns {:>14.4g}\n",
+                       result.name, width, result.iterations, result.mean,
+                       result.best,
+                       result.mean > 0.0 ? result.items * 1e9 / result.mean
+                                         : 0.0);
+    }
+
+    return std::fwrite(out.data(), 1, out.size(), file) == out.size() and
+           std::fflush(file) == 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bigram_index.hpp"
+#include "dictionary.hpp"
+#include "generator.hpp"
+#include "latency.hpp"
+#include "length_index.hpp"
+#include "profile.hpp"
+#include "sampling.hpp"
+
+namespace tpr {
+
+// How much a word's weight grows per unit of slowness of its bigrams, a
+// word with one bigram typed twice as slow as the median is drawn
+// `1 + adaptive_boost` times as often.
+inline constexpr double adaptive_boost = 4.0;
+
+// Draws candidate words (with replacement) biased toward words holding the
+// user's slow bigrams. A word weighs `base * (1 + adaptive_boost * s)` where
+// `base` is 1 or its rank weight and `s` sums the slowness of its distinct
+// bigrams. Weights live in a Fenwick tree, so updating a bigram only
+// touches the words containing it instead of rebuilding the sampler.
+class AdaptiveSampler {
+   public:
+    using allocator_type = FenwickTree::allocator_type;
+
+    AdaptiveSampler(const Candidates& candidates, const BigramIndex& index,
+                    std::size_t words, bool weighted,
+                    const allocator_type& allocator = {})
+        : index_(index),
+          base_(words, 0.0, allocator),
+          slowness_(words, 0.0, allocator),
+          bigrams_(BigramIndex::bigram_count, 0.0, allocator),
+          tree_(base_weights(candidates, weighted), allocator) {}
+
+    // Starts from the slowness of the bigrams of `latencies`, summed per
+    // word and built into the tree at once rather than set word by word.
+    AdaptiveSampler(const Candidates& candidates, const BigramIndex& index,
+                    std::size_t words, bool weighted,
+                    const KeyLatencies& latencies,
+                    const allocator_type& allocator = {})
+        : index_(index),
+          base_(words, 0.0, allocator),
+          slowness_(words, 0.0, allocator),
+          bigrams_(BigramIndex::bigram_count, 0.0, allocator),
+          tree_(initial_weights(candidates, weighted, latencies), allocator) {}
+
+    // Sets the slowness of `bigram`, 0 for bigrams typed no slower than
+    // usual.
+    auto update(uint16_t bigram, double slowness) noexcept -> void {
+        const auto delta = slowness - bigrams_[bigram];
+
+        if (delta == 0.0) {
+            return;
+        }
+
+        bigrams_[bigram] = slowness;
+
+        for (const auto word : index_.words(bigram)) {
+            if (base_[word] == 0.0) {
+                continue;
+            }
+
+            slowness_[word] += delta;
+            tree_.set(word,
+                      base_[word] * (1.0 + adaptive_boost * slowness_[word]));
+        }
+    }
+
+    // Slowness of every bigram typed often enough: how much slower than
+    // the median of all keys its median is.
+    auto update(const KeyLatencies& latencies) noexcept -> void {
+        usual_ = median(latencies.overall());
+
+        for (const auto& [bigram, histogram] : latencies.bigrams()) {
+            update(bigram, slowness(histogram));
+        }
+    }
+
+    // Slowness of the `changed` bigrams once `latencies` took in the
+    // sessions they were typed in. Only if that moved the median of all
+    // keys every bigram is updated.
+    auto update(const KeyLatencies& latencies,
+                const KeyLatencies::Bigrams& changed) noexcept -> void {
+        if (median(latencies.overall()) != usual_) {
+            update(latencies);
+            return;
+        }
+
+        for (const auto& [bigram, unused] : changed) {
+            if (const auto found = latencies.bigrams().find(bigram);
+                found != latencies.bigrams().end()) {
+                update(bigram, slowness(found->second));
+            }
+        }
+    }
+
+    [[nodiscard]] auto empty() const noexcept {
+        return tree_.empty() or tree_.total() <= 0.0;
+    }
+
+    // Returns a word index.
+    template <class URBG>
+    auto operator()(URBG& rng) const -> uint32_t {
+        return static_cast<uint32_t>(tree_(rng));
+    }
+
+   private:
+    auto base_weights(const Candidates& candidates, bool weighted)
+        -> std::span<const double> {
+        for (const auto range : candidates.ranges()) {
+            for (const auto word : range) {
+                base_[word] = weighted ? 1.0 / (word + 1.0) : 1.0;
+            }
+        }
+
+        return base_;
+    }
+
+    auto initial_weights(const Candidates& candidates, bool weighted,
+                         const KeyLatencies& latencies)
+        -> std::pmr::vector<double> {
+        base_weights(candidates, weighted);
+        usual_ = median(latencies.overall());
+
+        for (const auto& [bigram, histogram] : latencies.bigrams()) {
+            bigrams_[bigram] = slowness(histogram);
+
+            if (bigrams_[bigram] == 0.0) {
+                continue;
+            }
+
+            for (const auto word : index_.words(bigram)) {
+                if (base_[word] != 0.0) {
+                    slowness_[word] += bigrams_[bigram];
+                }
+            }
+        }
+
+        std::pmr::vector<double> weights(base_.size(), 0.0,
+                                         base_.get_allocator());
+
+        for (std::size_t word = 0; word < base_.size(); ++word) {
+            weights[word] =
+                base_[word] * (1.0 + adaptive_boost * slowness_[word]);
+        }
+
+        return weights;
+    }
+
+    static auto median(const LatencyHistogram& histogram) noexcept
+        -> std::chrono::duration<double> {
+        return std::chrono::duration<double>(histogram.quantile(0.5));
+    }
+
+    // 0 for bigrams typed too rarely to tell or no slower than usual.
+    [[nodiscard]] auto slowness(const LatencyHistogram& histogram)
+        const noexcept -> double {
+        if (usual_.count() <= 0.0 or histogram.count() < min_ranked_samples) {
+            return 0.0;
+        }
+
+        return std::max(median(histogram) / usual_ - 1.0, 0.0);
+    }
+
+    const BigramIndex& index_;
+    std::pmr::vector<double> base_;
+    std::pmr::vector<double> slowness_;
+    std::pmr::vector<double> bigrams_;
+    std::chrono::duration<double> usual_{};
+    FenwickTree tree_;
+};
+
+// Test of `amount` words drawn by `sampler` in draw order, empty if no
+// word matches.
+template <class T, class URBG>
+auto generate_adaptive_test(
+    const Dictionary<T>& dictionary, const AdaptiveSampler& sampler,
+    uint64_t amount, URBG& rng,
+    const std::pmr::polymorphic_allocator<std::type_identity_t<T>>& allocator)
+    -> std::pmr::basic_string<T> {
+    std::pmr::vector<uint32_t> sampled(allocator);
+
+    if (not sampler.empty()) {
+        TPR_PROFILE_SCOPE(sampling);
+
+        sampled.reserve(amount);
+        std::ranges::generate_n(std::back_inserter(sampled), amount,
+                                [&] { return sampler(rng); });
+    }
+
+    return assemble_test(dictionary, sampled, allocator);
+}
+
+}  // namespace tpr
@@ -0,0 +1,514 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "encoding.hpp"
+#include "mismatch.hpp"
+
+namespace tpr {
+
+// Edits turning the target into what was typed.
+struct EditCounts {
+    std::size_t insertions = 0;     // typed but not in the target
+    std::size_t deletions = 0;      // in the target but not typed
+    std::size_t substitutions = 0;  // typed instead of the target
+
+    [[nodiscard]] auto total() const noexcept {
+        return insertions + deletions + substitutions;
+    }
+
+    auto operator+=(const EditCounts& other) noexcept -> EditCounts& {
+        insertions += other.insertions;
+        deletions += other.deletions;
+        substitutions += other.substitutions;
+        return *this;
+    }
+};
+
+namespace detail {
+
+struct AlignmentCell {
+    uint32_t cost;
+    uint32_t insertions;
+    uint32_t deletions;
+    uint32_t substitutions;
+};
+
+inline constexpr AlignmentCell unreachable_cell{UINT32_MAX / 2, 0, 0, 0};
+
+// Levenshtein distances restricted to the diagonals |i - j| <= band of all
+// of `target` against every prefix of `typed`. Rows only hold the band, so
+// memory is O(band) and time O(n * band). The last row is left in
+// `previous`, slot k holding column j = n + k - band. Distances are exact
+// whenever they do not exceed `band`.
+template <class Target, class Typed, class Equal>
+auto banded_rows(const Target& target, const Typed& typed, std::size_t band,
+                 Equal& equal, std::pmr::vector<AlignmentCell>& previous,
+                 std::pmr::vector<AlignmentCell>& current) -> void {
+    const auto n = std::ranges::size(target);
+    const auto m = std::ranges::size(typed);
+    const auto width = 2 * band + 1;
+
+    previous.assign(width, unreachable_cell);
+    current.assign(width, unreachable_cell);
+
+    // row 0: only insertions, slot k holds column j = i + k - band
+    for (std::size_t j = 0; j <= std::min(band, m); ++j) {
+        previous[band + j] = {static_cast<uint32_t>(j),
+                              static_cast<uint32_t>(j), 0, 0};
+    }
+
+    for (std::size_t i = 1; i <= n; ++i) {
+        std::ranges::fill(current, unreachable_cell);
+
+        const auto first = i > band ? i - band : 0;
+        const auto last = std::min(m, i + band);
+
+        for (auto j = first; j <= last; ++j) {
+            const auto k = j + band - i;
+            auto& cell = current[k];
+
+            if (j == 0) {
+                cell = {static_cast<uint32_t>(i), 0, static_cast<uint32_t>(i),
+                        0};
+                continue;
+            }
+
+            const bool same = equal(target[i - 1], typed[j - 1]);
+
+            auto diagonal = previous[k];
+            diagonal.cost += not same;
+            diagonal.substitutions += not same;
+
+            cell = diagonal;
+
+            if (k + 1 < width and previous[k + 1].cost + 1 < cell.cost) {
+                cell = previous[k + 1];
+                cell.cost += 1;
+                cell.deletions += 1;
+            }
+
+            if (k > 0 and current[k - 1].cost + 1 < cell.cost) {
+                cell = current[k - 1];
+                cell.cost += 1;
+                cell.insertions += 1;
+            }
+        }
+
+        std::swap(previous, current);
+    }
+}
+
+// Levenshtein distance restricted to the diagonals |i - j| <= band, which
+// must include the final diagonal m - n.
+template <class Target, class Typed, class Equal>
+auto banded_alignment(const Target& target, const Typed& typed,
+                      std::size_t band, Equal& equal,
+                      std::pmr::vector<AlignmentCell>& previous,
+                      std::pmr::vector<AlignmentCell>& current)
+    -> AlignmentCell {
+    banded_rows(target, typed, band, equal, previous, current);
+
+    return previous[std::ranges::size(typed) + band -
+                    std::ranges::size(target)];
+}
+
+}  // namespace detail
+
+// Minimal edits between two random access sequences. Starts with a narrow
+// band around the main diagonal and doubles it until the distance fits,
+// so time is O(n * distance) and memory O(distance).
+template <class Target, class Typed, class Equal = std::equal_to<>>
+auto align(const Target& target, const Typed& typed,
+           std::pmr::memory_resource* resource =
+               std::pmr::get_default_resource(),
+           Equal equal = {}) -> EditCounts {
+    const auto n = std::ranges::size(target);
+    const auto m = std::ranges::size(typed);
+    const auto difference = n > m ? n - m : m - n;
+    const auto longest = std::max(n, m);
+
+    std::pmr::vector<detail::AlignmentCell> previous(resource);
+    std::pmr::vector<detail::AlignmentCell> current(resource);
+
+    for (auto band = std::max<std::size_t>(difference, 8);;
+         band = std::min(band * 2, longest)) {
+        const auto cell = detail::banded_alignment(target, typed, band, equal,
+                                                   previous, current);
+
+        if (cell.cost <= band or band >= longest) {
+            return {cell.insertions, cell.deletions, cell.substitutions};
+        }
+    }
+}
+
+namespace detail {
+
+struct Diagonal {
+    int64_t row;  // furthest target position reached
+    uint32_t insertions;
+    uint32_t deletions;
+    uint32_t substitutions;
+};
+
+inline constexpr Diagonal unreached_diagonal{INT64_MIN / 2, 0, 0, 0};
+
+// Hirschberg's traceback over the bands of `banded_rows`: the target is
+// split in half, the typed position where an optimal alignment crosses
+// the split is found from the distances of both halves computed forwards
+// and backwards, and both halves are traced on their own. Every band is
+// as wide as the known distance of its part, so memory stays O(d) besides
+// the positions written and time O((n + m) * d) plus O(n log n).
+template <class T>
+struct Traceback {
+    std::pmr::vector<uint32_t>* wrong;
+    std::pmr::vector<uint32_t>* missed;
+    std::pmr::vector<AlignmentCell> forward;
+    std::pmr::vector<AlignmentCell> backward;
+    std::pmr::vector<AlignmentCell> scratch;
+    EditCounts edits;
+
+    static auto push(std::pmr::vector<uint32_t>* out, std::size_t at) -> void {
+        if (out) {
+            out->push_back(static_cast<uint32_t>(at));
+        }
+    }
+
+    auto insert(std::size_t column) -> void {
+        push(wrong, column);
+        ++edits.insertions;
+    }
+
+    auto remove(std::size_t row) -> void {
+        push(missed, row);
+        ++edits.deletions;
+    }
+
+    auto substitute(std::size_t row, std::size_t column) -> void {
+        push(wrong, column);
+        push(missed, row);
+        ++edits.substitutions;
+    }
+
+    // Records the edits of `target` at `row` against `typed` at `column`,
+    // `cost` apart, in increasing order.
+    auto trace(std::basic_string_view<T> target,
+               std::basic_string_view<T> typed, std::size_t row,
+               std::size_t column, std::size_t cost) -> void {
+        const auto prefix =
+            mismatch(target.data(), typed.data(),
+                     std::min(target.size(), typed.size()) * sizeof(T)) /
+            sizeof(T);
+
+        target.remove_prefix(prefix);
+        typed.remove_prefix(prefix);
+        row += prefix;
+        column += prefix;
+
+        while (not target.empty() and not typed.empty() and
+               target.back() == typed.back()) {
+            target.remove_suffix(1);
+            typed.remove_suffix(1);
+        }
+
+        const auto n = target.size();
+        const auto m = typed.size();
+
+        if (not n or not m or not cost) {
+            for (std::size_t j = 0; j < m; ++j) {
+                insert(column + j);
+            }
+
+            for (std::size_t i = 0; i < n; ++i) {
+                remove(row + i);
+            }
+
+            return;
+        }
+
+        if (n == 1 or m == 1) {
+            // one character against a run: it matches where found, every
+            // other character is an edit, otherwise it is substituted for
+            // the first of the run
+            const auto match = n == 1 ? typed.find(target[0])
+                                      : target.find(typed[0]);
+            const auto kept = match == std::basic_string_view<T>::npos
+                                  ? std::size_t{0}
+                                  : match;
+
+            for (std::size_t k = 0; k < std::max(n, m); ++k) {
+                if (k != kept) {
+                    n == 1 ? insert(column + k) : remove(row + k);
+                } else if (match == std::basic_string_view<T>::npos) {
+                    substitute(row, column);
+                }
+            }
+
+            return;
+        }
+
+        const auto middle = n / 2;
+        const auto band = cost;
+
+        std::equal_to<> equal;
+        banded_rows(target.substr(0, middle), typed, band, equal, forward,
+                    scratch);
+
+        const auto back_target = target.substr(middle) | std::views::reverse;
+        const auto back_typed = typed | std::views::reverse;
+        banded_rows(back_target, back_typed, band, equal, backward, scratch);
+
+        // best column of the split, slots are relative to both row ends
+        std::size_t split = 0;
+        std::size_t before = 0;
+        std::size_t after = 0;
+        std::size_t best = SIZE_MAX;
+
+        const auto rest = n - middle;
+
+        for (auto j = middle > band ? middle - band : 0;
+             j <= std::min(m, middle + band); ++j) {
+            const auto back = m - j;
+
+            if (back + band < rest or back > rest + band) {
+                continue;
+            }
+
+            const auto& ahead = forward[j + band - middle];
+            const auto& behind = backward[back + band - rest];
+
+            if (ahead.cost + behind.cost < best) {
+                best = ahead.cost + behind.cost;
+                split = j;
+                before = ahead.cost;
+                after = behind.cost;
+            }
+        }
+
+        trace(target.substr(0, middle), typed.substr(0, split), row, column,
+              before);
+        trace(target.substr(middle), typed.substr(split), row + middle,
+              column + split, after);
+    }
+};
+
+}  // namespace detail
+
+// Edit distance of two texts by diagonal transitions (Ukkonen, Landau and
+// Vishkin): for every cost d only the furthest reaching point of each
+// diagonal is kept and matching runs are skipped with the vectorized
+// `mismatch`, so work is spent on the mismatching spans only. Time is
+// O((n + m) * d) plus the scans, memory O(d). Wider code units are
+// compared as bytes too, a mismatching byte rounds down to its unit.
+//
+// When `wrong` or `missed` is given an optimal alignment is traced back in
+// linear space and the counts returned are those of that alignment.
+// `wrong` receives the positions of wrongly typed characters (substituted
+// or inserted), `missed` the positions of target characters that were not
+// typed correctly (substituted or deleted), both in increasing order.
+template <class T>
+auto align_text(std::basic_string_view<T> target,
+                std::basic_string_view<T> typed,
+                std::pmr::memory_resource* resource =
+                    std::pmr::get_default_resource(),
+                std::pmr::vector<uint32_t>* wrong = nullptr,
+                std::pmr::vector<uint32_t>* missed = nullptr) -> EditCounts {
+    using detail::Diagonal;
+
+    const auto n = static_cast<int64_t>(target.size());
+    const auto m = static_cast<int64_t>(typed.size());
+    const int64_t goal = m - n;
+
+    const auto slide = [&](int64_t row, int64_t diagonal) {
+        const auto column = row + diagonal;
+        const auto size =
+            static_cast<std::size_t>(std::min(n - row, m - column));
+
+        return row + static_cast<int64_t>(
+                         mismatch(target.data() + row, typed.data() + column,
+                                  size * sizeof(T)) /
+                         sizeof(T));
+    };
+
+    std::pmr::vector<Diagonal> previous(resource);
+    std::pmr::vector<Diagonal> current(resource);
+
+    current.push_back({slide(0, 0), 0, 0, 0});
+
+    int64_t cost = 0;
+
+    const auto reached = [&] {
+        return goal >= -cost and goal <= cost and
+               current[goal + cost].row >= n;
+    };
+
+    while (not reached()) {
+        std::swap(previous, current);
+        ++cost;
+
+        // grown geometrically, a monotonic resource keeps every buffer
+        const auto width = static_cast<std::size_t>(2 * cost + 1);
+
+        if (current.capacity() < width) {
+            current.reserve(std::max(width, 2 * current.capacity()));
+        }
+
+        current.assign(width, detail::unreached_diagonal);
+
+        const auto from = [&](int64_t diagonal) -> const Diagonal& {
+            const auto index = diagonal + cost - 1;
+
+            return index >= 0 and index < static_cast<int64_t>(previous.size())
+                       ? previous[index]
+                       : detail::unreached_diagonal;
+        };
+
+        for (auto diagonal = std::max(-cost, -n);
+             diagonal <= std::min(cost, m); ++diagonal) {
+            auto& best = current[diagonal + cost];
+
+            const auto consider = [&](const Diagonal& source, int64_t row,
+                                      EditCounts edit) {
+                if (row > best.row and row <= n and row + diagonal <= m and
+                    row + diagonal >= 0) {
+                    best = source;
+                    best.row = row;
+                    best.substitutions += edit.substitutions;
+                    best.deletions += edit.deletions;
+                    best.insertions += edit.insertions;
+                }
+            };
+
+            consider(from(diagonal), from(diagonal).row + 1,
+                     {.substitutions = 1});
+            consider(from(diagonal + 1), from(diagonal + 1).row + 1,
+                     {.deletions = 1});
+            consider(from(diagonal - 1), from(diagonal - 1).row,
+                     {.insertions = 1});
+
+            if (best.row >= 0) {
+                best.row = slide(best.row, diagonal);
+            }
+        }
+    }
+
+    const auto& end = current[goal + cost];
+
+    if (wrong or missed) {
+        detail::Traceback<T> traceback{
+            wrong,
+            missed,
+            std::pmr::vector<detail::AlignmentCell>(resource),
+            std::pmr::vector<detail::AlignmentCell>(resource),
+            std::pmr::vector<detail::AlignmentCell>(resource),
+            {},
+        };
+
+        traceback.trace(target, typed, 0, 0, static_cast<std::size_t>(cost));
+
+        return traceback.edits;
+    }
+
+    return {end.insertions, end.deletions, end.substitutions};
+}
+
+// align_text over the characters of `Encoding`. Ascii compares code units
+// and is align_text itself. Utf8 compares graphemes, so a wrong accented
+// letter is one substitution whatever its bytes. Positions in `wrong` and
+// `missed` are code units, every unit of a wrong grapheme is listed.
+template <class Encoding, class T>
+auto align_characters(std::basic_string_view<T> target,
+                      std::basic_string_view<T> typed,
+                      std::pmr::memory_resource* resource =
+                          std::pmr::get_default_resource(),
+                      std::pmr::vector<uint32_t>* wrong = nullptr,
+                      std::pmr::vector<uint32_t>* missed = nullptr)
+    -> EditCounts {
+    if constexpr (std::is_same_v<Encoding, Ascii>) {
+        return align_text(target, typed, resource, wrong, missed);
+    } else {
+        GraphemeSplitter<T> splitter(resource);
+
+        std::pmr::u32string target_keys(resource);
+        std::pmr::u32string typed_keys(resource);
+        std::pmr::vector<uint32_t> target_starts(resource);
+        std::pmr::vector<uint32_t> typed_starts(resource);
+
+        splitter.split(target, target_keys, target_starts);
+        splitter.split(typed, typed_keys, typed_starts);
+
+        std::pmr::vector<uint32_t> wrong_graphemes(resource);
+        std::pmr::vector<uint32_t> missed_graphemes(resource);
+
+        const auto edits = align_text<char32_t>(
+            target_keys, typed_keys, resource,
+            wrong ? &wrong_graphemes : nullptr,
+            missed ? &missed_graphemes : nullptr);
+
+        const auto units = [](std::span<const uint32_t> graphemes,
+                              std::span<const uint32_t> starts,
+                              std::pmr::vector<uint32_t>* out) {
+            if (not out) {
+                return;
+            }
+
+            for (const auto grapheme : graphemes) {
+                for (auto unit = starts[grapheme]; unit < starts[grapheme + 1];
+                     ++unit) {
+                    out->push_back(unit);
+                }
+            }
+        };
+
+        units(wrong_graphemes, typed_starts, wrong);
+        units(missed_graphemes, target_starts, missed);
+
+        return edits;
+    }
+}
+
+// Space separated words of `text`, empty words are dropped.
+template <class T>
+auto split_words(std::basic_string_view<T> text,
+                 std::pmr::memory_resource* resource)
+    -> std::pmr::vector<std::basic_string_view<T>> {
+    std::pmr::vector<std::basic_string_view<T>> words(resource);
+
+    for (const auto word : text | std::views::split(T(' '))) {
+        if (not std::ranges::empty(word)) {
+            words.emplace_back(std::ranges::data(word),
+                               std::ranges::size(word));
+        }
+    }
+
+    return words;
+}
+
+struct Score {
+    EditCounts characters;
+    EditCounts words;
+};
+
+// Character and word level alignment of a typed test against its target.
+template <class T, class Encoding = Ascii>
+auto score(std::basic_string_view<T> target, std::basic_string_view<T> typed,
+           std::pmr::memory_resource* resource =
+               std::pmr::get_default_resource()) -> Score {
+    return {
+        .characters = align_characters<Encoding>(target, typed, resource),
+        .words = align(split_words(target, resource),
+                       split_words(typed, resource), resource),
+    };
+}
+
+}  // namespace tpr
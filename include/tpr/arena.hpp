@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace tpr {
+
+// Initial sizes of the per thread arenas, generation threads need room for
+// a test, scoring threads for a test, its typed text and their alignment.
+inline constexpr std::size_t test_arena_size = 64 * 1024;
+inline constexpr std::size_t scoring_arena_size = 256 * 1024;
+
+// An arena never grows past this, larger tasks keep going to the heap
+// instead of pinning their memory for the rest of the run.
+inline constexpr std::size_t max_arena_size = 16 * 1024 * 1024;
+
+// Memory for what one thread allocates while working on a single task: a
+// test string, an alignment, an output buffer. Nothing is freed until
+// `reset()` after the task, so allocating is a pointer bump and threads
+// never contend on an allocator. A task that did not fit went to the heap
+// for the rest, the arena then grows its buffer on reset so the next task
+// of that size does not.
+//
+// Owned by one thread and never shared, data read by several threads is
+// allocated once up front and only read afterwards. The buffer is not
+// zeroed, so pages it never gets to stay untouched.
+class ThreadArena {
+   public:
+    explicit ThreadArena(std::size_t size = test_arena_size)
+        : storage_(std::make_unique_for_overwrite<std::byte[]>(size)),
+          size_(size) {
+        arena_.emplace(storage_.get(), size_, &heap_);
+    }
+
+    ThreadArena(const ThreadArena&) = delete;
+    auto operator=(const ThreadArena&) -> ThreadArena& = delete;
+
+    [[nodiscard]] auto resource() noexcept -> std::pmr::memory_resource* {
+        return &*arena_;
+    }
+
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+        return size_;
+    }
+
+    // Frees every allocation since the last reset.
+    auto reset() -> void {
+        const auto spilled = heap_.bytes();
+
+        if (not spilled or size_ >= max_arena_size) {
+            arena_->release();
+            heap_.clear();
+            return;
+        }
+
+        size_ = std::min(std::bit_ceil(size_ + spilled), max_arena_size);
+
+        arena_.reset();
+        heap_.clear();
+
+        storage_ = std::make_unique_for_overwrite<std::byte[]>(size_);
+        arena_.emplace(storage_.get(), size_, &heap_);
+    }
+
+   private:
+    // Upstream of the arena, counts what it had to take from the heap.
+    class Heap : public std::pmr::memory_resource {
+       public:
+        [[nodiscard]] auto bytes() const noexcept -> std::size_t {
+            return bytes_;
+        }
+
+        auto clear() noexcept -> void { bytes_ = 0; }
+
+       private:
+        auto do_allocate(std::size_t bytes, std::size_t alignment)
+            -> void* override {
+            bytes_ += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes,
+                                                             alignment);
+        }
+
+        auto do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+            -> void override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        [[nodiscard]] auto do_is_equal(
+            const std::pmr::memory_resource& other) const noexcept
+            -> bool override {
+            return this == &other;
+        }
+
+        std::size_t bytes_ = 0;
+    };
+
+    Heap heap_;
+    std::unique_ptr<std::byte[]> storage_;
+    std::size_t size_;
+    std::optional<std::pmr::monotonic_buffer_resource> arena_;
+};
+
+}  // namespace tpr
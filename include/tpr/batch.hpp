@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "arena.hpp"
+#include "generator.hpp"
+#include "random.hpp"
+
+namespace tpr {
+
+// Tests are generated in blocks, block `b` always uses an engine seeded
+// with `(seed, b)`, so the output only depends on the seed and not on the
+// number of threads or on scheduling.
+inline constexpr uint64_t batch_block_size = 256;
+
+// Writes `count` newline separated tests of a TestGenerator or a
+// MixedGenerator to `output` using `threads` workers, returns false if
+// writing failed.
+template <class Generator>
+auto generate_batch(const Generator& generator, const TestConfig& config,
+                    uint64_t count, unsigned threads, uint64_t seed,
+                    std::FILE* output) -> bool {
+    using T = typename Generator::char_type;
+    using Engine = typename Generator::engine_type;
+
+    threads = std::max(threads, 1u);
+
+    const uint64_t blocks = (count + batch_block_size - 1) / batch_block_size;
+    const uint64_t round = uint64_t{threads} * 16;
+
+    std::vector<std::basic_string<T>> outputs(
+        static_cast<std::size_t>(std::min(round, blocks)));
+
+    for (uint64_t first = 0; first < blocks; first += round) {
+        const uint64_t last = std::min(blocks, first + round);
+        std::atomic<uint64_t> next = first;
+
+        const auto work = [&] {
+            // reset after each test
+            ThreadArena arena(test_arena_size);
+
+            for (auto block = next++; block < last; block = next++) {
+                auto& text = outputs[block - first];
+                text.clear();
+
+                auto engine = make_engine<Engine>(seed, block);
+
+                const auto begin = block * batch_block_size;
+                const auto end = std::min(count, begin + batch_block_size);
+
+                for (auto test = begin; test < end; ++test) {
+                    text.append(
+                        generator.generate(config, engine, arena.resource()));
+                    text.push_back(T('\n'));
+                    arena.reset();
+                }
+            }
+        };
+
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(threads - 1);
+
+            for (unsigned i = 1; i < threads; ++i) {
+                workers.emplace_back(work);
+            }
+
+            work();
+        }
+
+        for (uint64_t block = first; block < last; ++block) {
+            const auto& text = outputs[block - first];
+
+            if (std::fwrite(text.data(), sizeof(T), text.size(), output) !=
+                text.size()) {
+                return false;
+            }
+        }
+    }
+
+    return std::fflush(output) == 0;
+}
+
+}  // namespace tpr
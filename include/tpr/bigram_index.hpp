@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "latency.hpp"
+#include "mapped_file.hpp"
+
+namespace tpr {
+
+// Inverted index from every bigram, `KeyLatencies::bigram(a, b)`, to the
+// words containing it. Lists are in dictionary (frequency) order and hold
+// every word once, however often it repeats the bigram. The tables either
+// point into a mapped cache file or are owned.
+class BigramIndex {
+   public:
+    static constexpr std::size_t bigram_count = 1 << 16;
+
+    using allocator_type = std::pmr::polymorphic_allocator<uint32_t>;
+    using container = std::pmr::vector<uint32_t>;
+
+    // Index loaded from a cache file, all tables live in the mapping.
+    BigramIndex(MappedFile file, std::span<const uint32_t> offsets,
+                std::span<const uint32_t> words) noexcept
+        : file_(std::move(file)), offsets_(offsets), words_(words) {}
+
+    // Index built from a dictionary, two counting passes over its words.
+    template <class T>
+    explicit BigramIndex(const Dictionary<T>& dictionary,
+                         const allocator_type& allocator = {})
+        : owned_offsets_(bigram_count + 1, 0, allocator),
+          owned_words_(allocator) {
+        static_assert(sizeof(T) == 1, "bigrams are pairs of bytes");
+
+        uint16_t seen[max_word_length];
+
+        const auto for_each_bigram = [&](auto&& visit) {
+            for (std::size_t i = 0; i < dictionary.size(); ++i) {
+                const auto word = dictionary[i];
+                std::size_t count = 0;
+
+                for (std::size_t j = 1; j < word.size(); ++j) {
+                    seen[count++] = KeyLatencies::bigram(
+                        static_cast<char>(word[j - 1]),
+                        static_cast<char>(word[j]));
+                }
+
+                std::sort(seen, seen + count);
+
+                for (const auto bigram : std::span(
+                         seen, std::unique(seen, seen + count))) {
+                    visit(bigram, static_cast<uint32_t>(i));
+                }
+            }
+        };
+
+        for_each_bigram([this](uint16_t bigram, uint32_t /*word*/) {
+            ++owned_offsets_[bigram + 1];
+        });
+
+        for (std::size_t i = 1; i <= bigram_count; ++i) {
+            owned_offsets_[i] += owned_offsets_[i - 1];
+        }
+
+        owned_words_.resize(owned_offsets_.back());
+
+        container next(owned_offsets_.begin(), owned_offsets_.end() - 1,
+                       allocator);
+
+        for_each_bigram([this, &next](uint16_t bigram, uint32_t word) {
+            owned_words_[next[bigram]++] = word;
+        });
+
+        offsets_ = owned_offsets_;
+        words_ = owned_words_;
+    }
+
+    // Moving a vector keeps its buffer, so the spans stay valid.
+    BigramIndex(BigramIndex&&) noexcept = default;
+    auto operator=(BigramIndex&&) -> BigramIndex& = delete;
+
+    // Words containing `bigram` in frequency order.
+    [[nodiscard]] auto words(uint16_t bigram) const noexcept
+        -> std::span<const uint32_t> {
+        return words_.subspan(offsets_[bigram],
+                              offsets_[bigram + 1] - offsets_[bigram]);
+    }
+
+    [[nodiscard]] auto offsets() const noexcept { return offsets_; }
+    [[nodiscard]] auto entries() const noexcept { return words_; }
+
+    // True if the tables index a dictionary of `words` words: the offsets
+    // begin at zero, never decrease and end at the number of entries, and
+    // every entry names a word.
+    [[nodiscard]] auto valid(std::size_t words) const noexcept -> bool {
+        return offsets_.size() == bigram_count + 1 and offsets_.front() == 0 and
+               offsets_.back() == words_.size() and
+               std::ranges::is_sorted(offsets_) and
+               std::ranges::all_of(
+                   words_, [words](uint32_t word) { return word < words; });
+    }
+
+   private:
+    MappedFile file_;
+    container owned_offsets_;
+    container owned_words_;
+    std::span<const uint32_t> offsets_;
+    std::span<const uint32_t> words_;
+};
+
+}  // namespace tpr
@@ -0,0 +1,525 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "profile.hpp"
+
+namespace tpr {
+
+// Compiled dictionary (.tpd) layout, all integers in native byte order:
+//
+//   TpdHeader | uint32_t offsets[count] | uint8_t lengths[count] | blob
+//
+// where word `i` is `blob[offsets[i], offsets[i] + lengths[i])`.
+struct TpdHeader {
+    static constexpr uint32_t signature = 0x31445054;  // "TPD1"
+    static constexpr uint32_t current_version = 1;
+
+    uint32_t magic = signature;
+    uint32_t version = current_version;
+    uint64_t count = 0;
+    uint64_t blob_size = 0;
+};
+
+static_assert(sizeof(TpdHeader) == 24);
+
+// Text dictionaries smaller than this are parsed on a single thread.
+inline constexpr std::size_t parallel_parse_threshold = 8 * 1024 * 1024;
+
+// Words longer than this do not fit the per-word length byte and are
+// skipped while loading a text dictionary.
+inline constexpr std::size_t max_word_length =
+    std::numeric_limits<uint8_t>::max();
+
+// Frequency ordered word list. Words are views into the mapped file, the
+// offsets and lengths tables either point into a mapped .tpd file or into
+// tables built while scanning a text file.
+template <class T>
+class Dictionary {
+   public:
+    using value_type = std::basic_string_view<T>;
+    using offsets_container = std::pmr::vector<uint32_t>;
+    using lengths_container = std::pmr::vector<uint8_t>;
+    using text_container = std::pmr::vector<T>;
+
+    class iterator {
+       public:
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::basic_string_view<T>;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() noexcept = default;
+        iterator(const Dictionary* dictionary, std::size_t index) noexcept
+            : dictionary_(dictionary), index_(index) {}
+
+        auto operator*() const noexcept { return (*dictionary_)[index_]; }
+        auto operator[](difference_type n) const noexcept {
+            return (*dictionary_)[index_ + n];
+        }
+
+        auto operator++() noexcept -> iterator& { return ++index_, *this; }
+        auto operator--() noexcept -> iterator& { return --index_, *this; }
+        auto operator++(int) noexcept { return iterator{dictionary_, index_++}; }
+        auto operator--(int) noexcept { return iterator{dictionary_, index_--}; }
+
+        auto operator+=(difference_type n) noexcept -> iterator& {
+            return index_ += n, *this;
+        }
+        auto operator-=(difference_type n) noexcept -> iterator& {
+            return index_ -= n, *this;
+        }
+
+        friend auto operator+(iterator it, difference_type n) noexcept {
+            return it += n;
+        }
+        friend auto operator+(difference_type n, iterator it) noexcept {
+            return it += n;
+        }
+        friend auto operator-(iterator it, difference_type n) noexcept {
+            return it -= n;
+        }
+        friend auto operator-(const iterator& lhs, const iterator& rhs) noexcept
+            -> difference_type {
+            return static_cast<difference_type>(lhs.index_) -
+                   static_cast<difference_type>(rhs.index_);
+        }
+
+        friend auto operator==(const iterator& lhs, const iterator& rhs) noexcept
+            -> bool {
+            return lhs.index_ == rhs.index_;
+        }
+        friend auto operator<=>(const iterator& lhs,
+                                const iterator& rhs) noexcept {
+            return lhs.index_ <=> rhs.index_;
+        }
+
+       private:
+        const Dictionary* dictionary_ = nullptr;
+        std::size_t index_ = 0;
+    };
+
+    // Dictionary loaded from a .tpd file, all tables live in the mapping.
+    Dictionary(MappedFile file, std::span<const uint32_t> offsets,
+               std::span<const uint8_t> lengths,
+               std::span<const T> blob) noexcept
+        : file_(std::move(file)),
+          offsets_(offsets),
+          lengths_(lengths),
+          text_(blob) {}
+
+    // Dictionary scanned from a text file, tables are owned.
+    Dictionary(MappedFile file, offsets_container offsets,
+               lengths_container lengths) noexcept
+        : file_(std::move(file)),
+          owned_offsets_(std::move(offsets)),
+          owned_lengths_(std::move(lengths)),
+          offsets_(owned_offsets_),
+          lengths_(owned_lengths_),
+          text_(file_.template view<T>()) {}
+
+    // Dictionary read from a stream, the characters are owned too.
+    Dictionary(text_container text, offsets_container offsets,
+               lengths_container lengths) noexcept
+        : owned_text_(std::move(text)),
+          owned_offsets_(std::move(offsets)),
+          owned_lengths_(std::move(lengths)),
+          offsets_(owned_offsets_),
+          lengths_(owned_lengths_),
+          text_(owned_text_) {}
+
+    // Moving a vector keeps its buffer, so the spans stay valid. Assignment
+    // could reallocate between different resources and is not provided.
+    Dictionary(Dictionary&&) noexcept = default;
+    auto operator=(Dictionary&&) -> Dictionary& = delete;
+
+    [[nodiscard]] auto begin() const noexcept { return iterator{this, 0}; }
+    [[nodiscard]] auto end() const noexcept { return iterator{this, size()}; }
+
+    [[nodiscard]] auto size() const noexcept { return lengths_.size(); }
+    [[nodiscard]] auto empty() const noexcept { return lengths_.empty(); }
+
+    // The tables of a mapped .tpd are not checked when it is loaded, so a
+    // word reaching past the characters, which only a corrupt file has, is
+    // cut at their end here.
+    [[nodiscard]] auto operator[](std::size_t i) const noexcept {
+        const auto offset = std::min<std::size_t>(offsets_[i], text_.size());
+        const auto length =
+            std::min<std::size_t>(lengths_[i], text_.size() - offset);
+
+        return value_type{text_.data() + offset, length};
+    }
+
+    // Length of word `i` without touching the character data.
+    [[nodiscard]] auto length(std::size_t i) const noexcept -> std::size_t {
+        return lengths_[i];
+    }
+
+    [[nodiscard]] auto lengths() const noexcept { return lengths_; }
+
+    // Drops every word after the first `count` and the characters after
+    // them. Only the views shrink, tables and the mapping are kept.
+    auto truncate(std::size_t count) noexcept -> void {
+        count = std::min(count, size());
+
+        offsets_ = offsets_.first(count);
+        lengths_ = lengths_.first(count);
+        const auto end =
+            count ? std::size_t{offsets_[count - 1]} + lengths_[count - 1] : 0;
+
+        text_ = text_.first(std::min(end, text_.size()));
+    }
+
+    // Every character the words are views into, line breaks included for
+    // text files.
+    [[nodiscard]] auto text() const noexcept -> std::span<const T> {
+        return text_;
+    }
+
+    // The mapped file the words were read from, empty for streams.
+    [[nodiscard]] auto file() const noexcept -> const MappedFile& {
+        return file_;
+    }
+
+   private:
+    MappedFile file_;
+    text_container owned_text_;
+    offsets_container owned_offsets_;
+    lengths_container owned_lengths_;
+    std::span<const uint32_t> offsets_;
+    std::span<const uint8_t> lengths_;
+    std::span<const T> text_;
+};
+
+namespace detail {
+
+// Nullopt if the header of `file` is not that of a .tpd of `T` or the
+// tables do not fit the file. Only the header is read, and with a `limit`
+// the end of word `limit`: offsets and lengths are checked against the
+// characters when a word is looked up.
+template <class T>
+auto read_compiled_dictionary(MappedFile file, std::size_t limit = 0)
+    -> std::optional<Dictionary<T>> {
+    const auto bytes = file.bytes();
+
+    TpdHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    if (header.version != TpdHeader::current_version) {
+        return std::nullopt;
+    }
+
+    const uint64_t tables = header.count * (sizeof(uint32_t) + sizeof(uint8_t));
+
+    if (header.count > bytes.size() or header.blob_size > bytes.size() or
+        sizeof(header) + tables + header.blob_size * sizeof(T) !=
+            bytes.size()) {
+        return std::nullopt;
+    }
+
+    const auto* offsets = reinterpret_cast<const uint32_t*>(
+        bytes.data() + sizeof(header));
+    const auto* lengths = reinterpret_cast<const uint8_t*>(
+        bytes.data() + sizeof(header) + header.count * sizeof(uint32_t));
+    const auto* blob = reinterpret_cast<const T*>(
+        bytes.data() + sizeof(header) + tables);
+
+    auto dictionary = std::make_optional<Dictionary<T>>(
+        std::move(file), std::span{offsets, header.count},
+        std::span{lengths, header.count}, std::span{blob, header.blob_size});
+
+    if (limit) {
+        dictionary->truncate(limit);
+    }
+
+    return dictionary;
+}
+
+// Number of lines in `text`, a last line without a line break included.
+// Byte text is scanned with memchr, which libc vectorizes.
+template <class T>
+auto count_lines(std::basic_string_view<T> text) noexcept -> std::size_t {
+    if (text.empty()) {
+        return 0;
+    }
+
+    std::size_t lines = text.back() != T('\n');
+
+    if constexpr (sizeof(T) == 1) {
+        const auto* p = reinterpret_cast<const char*>(text.data());
+        const auto* const end = p + text.size();
+
+        while ((p = static_cast<const char*>(std::memchr(p, '\n', end - p)))) {
+            ++lines;
+            ++p;
+        }
+    } else {
+        lines += static_cast<std::size_t>(std::ranges::count(text, T('\n')));
+    }
+
+    return lines;
+}
+
+// Writes the offset and length of every line of `text[begin, end)` that
+// fits `max_word_length`, `begin` being the start of a line, stopping
+// after `limit` words. Returns the number of words written.
+template <class T>
+auto parse_lines(std::basic_string_view<T> text, std::size_t begin,
+                 std::size_t end, uint32_t* offsets, uint8_t* lengths,
+                 std::size_t limit =
+                     std::numeric_limits<std::size_t>::max()) noexcept
+    -> std::size_t {
+    using string_view = std::basic_string_view<T>;
+
+    std::size_t words = 0;
+
+    for (auto rest = text.substr(begin, end - begin);
+         not rest.empty() and words < limit;) {
+        const auto newline = rest.find(T('\n'));
+        auto word = rest.substr(0, newline);
+
+        if (word.ends_with(T('\r'))) {
+            word.remove_suffix(1);
+        }
+
+        if (word.size() <= max_word_length) {
+            offsets[words] = static_cast<uint32_t>(word.data() - text.data());
+            lengths[words] = static_cast<uint8_t>(word.size());
+            ++words;
+        }
+
+        if (newline == string_view::npos) {
+            break;
+        }
+
+        rest.remove_prefix(newline + 1);
+    }
+
+    return words;
+}
+
+// The line count bounds the number of words, so both tables are allocated
+// exactly once. Files of at least `parallel_parse_threshold` bytes are
+// split into `threads` chunks starting at line boundaries, every chunk
+// counts its lines and then parses them into its own slice of the tables,
+// so the words keep their frequency order. Smaller files are parsed on
+// the calling thread, starting threads would cost more than it saves.
+template <class T>
+auto read_text_dictionary(MappedFile file, unsigned threads,
+                          const std::pmr::polymorphic_allocator<T>& allocator)
+    -> std::optional<Dictionary<T>> {
+    const std::basic_string_view<T> text = file.template view<T>();
+
+    if (text.size() > std::numeric_limits<uint32_t>::max()) {
+        return std::nullopt;
+    }
+
+    if (text.size() * sizeof(T) < parallel_parse_threshold) {
+        threads = 1;
+    }
+
+    threads = std::max(threads, 1u);
+
+    // chunk `i` is text[starts[i], starts[i + 1])
+    std::vector<std::size_t> starts(threads + 1, text.size());
+    starts[0] = 0;
+
+    for (unsigned i = 1; i < threads; ++i) {
+        const auto middle = std::max(starts[i - 1], text.size() * i / threads);
+        const auto newline = text.find(T('\n'), middle);
+        starts[i] = newline == text.npos ? text.size() : newline + 1;
+    }
+
+    std::vector<std::size_t> lines(threads + 1, 0);
+
+    const auto in_parallel = [threads](auto&& work) {
+        std::vector<std::jthread> workers;
+        workers.reserve(threads - 1);
+
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back(work, i);
+        }
+
+        work(0u);
+    };
+
+    in_parallel([&](unsigned chunk) {
+        lines[chunk + 1] = count_lines(
+            text.substr(starts[chunk], starts[chunk + 1] - starts[chunk]));
+    });
+
+    for (unsigned i = 1; i <= threads; ++i) {
+        lines[i] += lines[i - 1];
+    }
+
+    typename Dictionary<T>::offsets_container offsets(lines.back(), 0,
+                                                      allocator);
+    typename Dictionary<T>::lengths_container lengths(lines.back(), 0,
+                                                      allocator);
+
+    std::vector<std::size_t> words(threads, 0);
+
+    in_parallel([&](unsigned chunk) {
+        words[chunk] = parse_lines(text, starts[chunk], starts[chunk + 1],
+                                   offsets.data() + lines[chunk],
+                                   lengths.data() + lines[chunk]);
+    });
+
+    // close the gaps left by skipped lines, usually there are none
+    std::size_t size = words[0];
+
+    for (unsigned i = 1; i < threads; ++i) {
+        std::copy_n(offsets.begin() + lines[i], words[i],
+                    offsets.begin() + size);
+        std::copy_n(lengths.begin() + lines[i], words[i],
+                    lengths.begin() + size);
+        size += words[i];
+    }
+
+    offsets.resize(size);
+    lengths.resize(size);
+
+    return std::make_optional<Dictionary<T>>(
+        std::move(file), std::move(offsets), std::move(lengths));
+}
+
+// Only the first `words` words of a text file, the lines after them are
+// never looked at and the tables are sized for the prefix.
+template <class T>
+auto read_text_prefix(MappedFile file, std::size_t words,
+                      const std::pmr::polymorphic_allocator<T>& allocator)
+    -> std::optional<Dictionary<T>> {
+    const std::basic_string_view<T> text = file.template view<T>();
+
+    if (text.size() > std::numeric_limits<uint32_t>::max()) {
+        return std::nullopt;
+    }
+
+    // a text has at most one line more than it has characters
+    words = std::min(words, text.size() + 1);
+
+    typename Dictionary<T>::offsets_container offsets(words, 0, allocator);
+    typename Dictionary<T>::lengths_container lengths(words, 0, allocator);
+
+    const auto size = parse_lines(text, 0, text.size(), offsets.data(),
+                                  lengths.data(), words);
+
+    offsets.resize(size);
+    lengths.resize(size);
+
+    auto dictionary = std::make_optional<Dictionary<T>>(
+        std::move(file), std::move(offsets), std::move(lengths));
+    dictionary->truncate(size);
+
+    return dictionary;
+}
+
+}  // namespace detail
+
+inline auto is_compiled_dictionary(const MappedFile& file) noexcept -> bool {
+    uint32_t magic = 0;
+
+    if (file.size() < sizeof(TpdHeader)) {
+        return false;
+    }
+
+    std::memcpy(&magic, file.bytes().data(), sizeof(magic));
+    return magic == TpdHeader::signature;
+}
+
+// Reads either a compiled .tpd dictionary (detected by its header) or a
+// newline separated text file, large text files are parsed by `threads`
+// threads. With a `limit` only the first `limit` words are read: of a text
+// file nothing after them is parsed, of a .tpd file nothing but the header
+// and the end of the last word kept, the rest of its tables stay untouched
+// in the mapping.
+template <class T>
+auto read_dictionary(const std::filesystem::path& path,
+                     const std::pmr::polymorphic_allocator<T>& allocator,
+                     unsigned threads = 1, std::size_t limit = 0)
+    -> std::optional<Dictionary<T>> {
+    auto file = [&path] {
+        TPR_PROFILE_SCOPE(dictionary_open);
+        return MappedFile::open(path);
+    }();
+
+    if (not file) {
+        return std::nullopt;
+    }
+
+    TPR_PROFILE_SCOPE(dictionary_parse);
+
+    if (is_compiled_dictionary(*file)) {
+        return detail::read_compiled_dictionary<T>(std::move(*file), limit);
+    }
+
+    if (limit) {
+        return detail::read_text_prefix<T>(std::move(*file), limit, allocator);
+    }
+
+    return detail::read_text_dictionary<T>(std::move(*file), threads,
+                                           allocator);
+}
+
+// Writes `dictionary` in the .tpd layout, returns false on I/O failure or if
+// the packed characters do not fit 32 bit offsets.
+template <class T>
+auto compile_dictionary(const Dictionary<T>& dictionary,
+                        const std::filesystem::path& path) -> bool {
+    TpdHeader header;
+    header.count = dictionary.size();
+
+    for (const auto length : dictionary.lengths()) {
+        header.blob_size += length;
+    }
+
+    if (header.blob_size > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+
+    std::ofstream stream(path, std::ios::out | std::ios::binary);
+
+    if (not stream) {
+        return false;
+    }
+
+    const auto write = [&stream](const void* data, std::size_t size) {
+        stream.write(static_cast<const char*>(data),
+                     static_cast<std::streamsize>(size));
+    };
+
+    write(&header, sizeof(header));
+
+    uint32_t offset = 0;
+
+    for (const auto length : dictionary.lengths()) {
+        write(&offset, sizeof(offset));
+        offset += length;
+    }
+
+    const auto lengths = dictionary.lengths();
+    write(lengths.data(), lengths.size_bytes());
+
+    for (const auto word : dictionary) {
+        write(word.data(), word.size() * sizeof(T));
+    }
+
+    return static_cast<bool>(stream.flush());
+}
+
+}  // namespace tpr
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tpr {
+
+// Encodings of dictionary text. Which one applies is checked once per
+// dictionary with `is_ascii`, everything depending on it is specialized at
+// compile time, so ASCII text runs the same byte code as before.
+struct Ascii {};  // every code unit is a character
+struct Utf8 {};   // characters are graphemes of UTF-8 encoded code points
+
+// True if no code unit of `text` is above 0x7f, so every encoding agrees
+// on its characters. Bytes are tested 8 at a time, a block at a time so
+// non-ASCII text stops early.
+template <class T>
+auto is_ascii(std::span<const T> text) noexcept -> bool {
+    if constexpr (sizeof(T) == 1) {
+        constexpr std::size_t block = 4096;
+        constexpr uint64_t high_bits = 0x8080808080808080;
+
+        const auto* bytes = reinterpret_cast<const unsigned char*>(text.data());
+        const auto size = text.size();
+
+        std::size_t i = 0;
+
+        while (i + 8 <= size) {
+            const auto end = std::min(size - size % 8, i + block);
+            uint64_t high = 0;
+
+            for (; i < end; i += 8) {
+                uint64_t word;
+                std::memcpy(&word, bytes + i, sizeof(word));
+                high |= word;
+            }
+
+            if (high & high_bits) {
+                return false;
+            }
+        }
+
+        return std::all_of(bytes + i, bytes + size,
+                           [](unsigned char c) { return c < 0x80; });
+    } else {
+        return std::ranges::all_of(text, [](T c) {
+            return static_cast<std::make_unsigned_t<T>>(c) < 0x80;
+        });
+    }
+}
+
+namespace detail {
+
+// Decodes the code point at `text[i]` and moves `i` past it. A malformed
+// or truncated sequence yields one lone surrogate per byte (0xdc00 plus
+// the byte), which only compares equal to the same byte.
+template <class T>
+constexpr auto decode(std::basic_string_view<T> text, std::size_t& i) noexcept
+    -> char32_t {
+    if constexpr (sizeof(T) > 1) {
+        return static_cast<char32_t>(text[i++]);
+    } else {
+        const auto byte = [&text](std::size_t k) -> char32_t {
+            return static_cast<unsigned char>(text[k]);
+        };
+
+        const auto lead = byte(i);
+
+        std::size_t size = 0;
+        char32_t point = 0;
+        char32_t low = 0x80;
+        char32_t high = 0xbf;
+
+        if (lead < 0x80) {
+            ++i;
+            return lead;
+        } else if (lead >= 0xc2 and lead <= 0xdf) {
+            size = 2;
+            point = lead & 0x1f;
+        } else if (lead >= 0xe0 and lead <= 0xef) {
+            // no overlong forms, no surrogates
+            size = 3;
+            point = lead & 0x0f;
+            low = lead == 0xe0 ? 0xa0 : 0x80;
+            high = lead == 0xed ? 0x9f : 0xbf;
+        } else if (lead >= 0xf0 and lead <= 0xf4) {
+            // no overlong forms, nothing above U+10FFFF
+            size = 4;
+            point = lead & 0x07;
+            low = lead == 0xf0 ? 0x90 : 0x80;
+            high = lead == 0xf4 ? 0x8f : 0xbf;
+        }
+
+        bool valid = size and i + size <= text.size();
+
+        for (std::size_t k = 1; valid and k < size; ++k) {
+            const auto continuation = byte(i + k);
+
+            valid = continuation >= (k == 1 ? low : 0x80) and
+                    continuation <= (k == 1 ? high : 0xbf);
+            point = point << 6 | (continuation & 0x3f);
+        }
+
+        if (not valid) {
+            ++i;
+            return 0xdc00 + lead;
+        }
+
+        i += size;
+        return point;
+    }
+}
+
+// Approximates the Extend and ZWJ classes of UAX #29: combining marks of
+// the common scripts, joiners, variation selectors, emoji modifiers and
+// tags. A code point of these belongs to the grapheme before it.
+constexpr auto extends_grapheme(char32_t point) noexcept -> bool {
+    constexpr std::array<std::pair<char32_t, char32_t>, 26> ranges{{
+        {0x0300, 0x036f},   {0x0483, 0x0489},  {0x0591, 0x05bd},
+        {0x05bf, 0x05c7},   {0x0610, 0x061a},  {0x064b, 0x065f},
+        {0x0670, 0x0670},   {0x06d6, 0x06ed},  {0x0900, 0x0903},
+        {0x093a, 0x094f},   {0x0951, 0x0957},  {0x0962, 0x0963},
+        {0x0e31, 0x0e31},   {0x0e34, 0x0e3a},  {0x0e47, 0x0e4e},
+        {0x1ab0, 0x1aff},   {0x1dc0, 0x1dff},  {0x200c, 0x200d},
+        {0x20d0, 0x20ff},   {0x302a, 0x302f},  {0x3099, 0x309a},
+        {0xfe00, 0xfe0f},   {0xfe20, 0xfe2f},  {0x1f3fb, 0x1f3ff},
+        {0xe0020, 0xe007f}, {0xe0100, 0xe01ef},
+    }};
+
+    return point >= 0x0300 and
+           std::ranges::any_of(ranges, [point](const auto& range) {
+               return point >= range.first and point <= range.second;
+           });
+}
+
+constexpr auto is_regional_indicator(char32_t point) noexcept -> bool {
+    return point >= 0x1f1e6 and point <= 0x1f1ff;
+}
+
+inline constexpr char32_t zero_width_joiner = 0x200d;
+
+// End of the grapheme starting at `text[i]`.
+template <class T>
+constexpr auto grapheme_end(std::basic_string_view<T> text,
+                            std::size_t i) noexcept -> std::size_t {
+    const auto first = decode(text, i);
+
+    std::size_t points = 1;
+    bool joined = false;
+
+    while (i < text.size()) {
+        auto next = i;
+        const auto point = decode(text, next);
+
+        const bool flag = points == 1 and is_regional_indicator(first) and
+                          is_regional_indicator(point);
+
+        if (not joined and not flag and not extends_grapheme(point)) {
+            break;
+        }
+
+        joined = point == zero_width_joiner;
+        i = next;
+        ++points;
+    }
+
+    return i;
+}
+
+}  // namespace detail
+
+template <class Encoding>
+struct encoding_traits;
+
+template <>
+struct encoding_traits<Ascii> {
+    template <class T>
+    static constexpr auto length(std::basic_string_view<T> text) noexcept
+        -> std::size_t {
+        return text.size();
+    }
+
+    // End of the character starting at `text[i]`.
+    template <class T>
+    static constexpr auto next(std::basic_string_view<T> /* text */,
+                               std::size_t i) noexcept -> std::size_t {
+        return i + 1;
+    }
+
+    // Start of the last character of a non empty `text`.
+    template <class T>
+    static constexpr auto last(std::basic_string_view<T> text) noexcept
+        -> std::size_t {
+        return text.size() - 1;
+    }
+
+    // Characters of `text`, the cells it takes on a terminal.
+    template <class T>
+    static constexpr auto characters(std::basic_string_view<T> text) noexcept
+        -> std::size_t {
+        return text.size();
+    }
+
+    // True if the last character of `text` is still missing code units.
+    template <class T>
+    static constexpr auto pending(std::basic_string_view<T> /* text */) noexcept
+        -> bool {
+        return false;
+    }
+};
+
+template <>
+struct encoding_traits<Utf8> {
+    // Code points in `text`, every byte but a continuation byte starts one.
+    // Wider code units are taken as code points.
+    template <class T>
+    static constexpr auto length(std::basic_string_view<T> text) noexcept
+        -> std::size_t {
+        if constexpr (sizeof(T) == 1) {
+            return static_cast<std::size_t>(
+                std::ranges::count_if(text, [](T c) {
+                    return (static_cast<unsigned char>(c) & 0xc0) != 0x80;
+                }));
+        } else {
+            return text.size();
+        }
+    }
+
+    // End of the grapheme starting at `text[i]`.
+    template <class T>
+    static constexpr auto next(std::basic_string_view<T> text,
+                               std::size_t i) noexcept -> std::size_t {
+        return detail::grapheme_end(text, i);
+    }
+
+    // Start of the last grapheme of a non empty `text`. Graphemes are only
+    // found front to back, so this walks the whole text.
+    template <class T>
+    static constexpr auto last(std::basic_string_view<T> text) noexcept
+        -> std::size_t {
+        std::size_t start = 0;
+
+        for (auto end = next(text, 0); end < text.size();
+             end = next(text, end)) {
+            start = end;
+        }
+
+        return start;
+    }
+
+    // Graphemes of `text`, the cells it takes on a terminal if none of
+    // them is wide.
+    template <class T>
+    static constexpr auto characters(std::basic_string_view<T> text) noexcept
+        -> std::size_t {
+        std::size_t count = 0;
+
+        for (std::size_t i = 0; i < text.size(); i = next(text, i)) {
+            ++count;
+        }
+
+        return count;
+    }
+
+    // True if `text` ends with the lead of a multibyte sequence whose
+    // continuation bytes did not all arrive yet.
+    template <class T>
+    static constexpr auto pending(std::basic_string_view<T> text) noexcept
+        -> bool {
+        if constexpr (sizeof(T) > 1) {
+            return false;
+        } else {
+            const auto byte = [&text](std::size_t i) {
+                return static_cast<unsigned char>(text[i]);
+            };
+
+            const auto size = text.size();
+
+            for (std::size_t back = 1; back <= std::min<std::size_t>(size, 3);
+                 ++back) {
+                const auto lead = byte(size - back);
+
+                if ((lead & 0xc0) == 0x80) {
+                    continue;
+                }
+
+                const std::size_t expected = lead >= 0xf0   ? 4
+                                             : lead >= 0xe0 ? 3
+                                             : lead >= 0xc2 ? 2
+                                                            : 1;
+
+                return lead <= 0xf4 and back < expected;
+            }
+
+            return false;
+        }
+    }
+};
+
+// Splits texts into graphemes, each named by a key: its code point if it
+// is a single one, otherwise a key above U+10FFFF shared by every equal
+// grapheme this splitter has seen. Keys of texts split by the same
+// splitter compare like their graphemes.
+template <class T>
+class GraphemeSplitter {
+   public:
+    static constexpr char32_t first_cluster_key = 0x110000;
+
+    explicit GraphemeSplitter(std::pmr::memory_resource* resource =
+                                  std::pmr::get_default_resource())
+        : clusters_(resource) {}
+
+    // Appends the key of every grapheme of `text` to `keys` and its first
+    // code unit to `starts`, followed by `text.size()`.
+    auto split(std::basic_string_view<T> text, std::pmr::u32string& keys,
+               std::pmr::vector<uint32_t>& starts) -> void {
+        for (std::size_t i = 0; i < text.size();) {
+            const auto start = i;
+
+            auto first_end = i;
+            auto key = detail::decode(text, first_end);
+
+            i = detail::grapheme_end(text, start);
+
+            if (i != first_end) {
+                key = clusters_
+                          .try_emplace(
+                              text.substr(start, i - start),
+                              first_cluster_key +
+                                  static_cast<char32_t>(clusters_.size()))
+                          .first->second;
+            }
+
+            keys.push_back(key);
+            starts.push_back(static_cast<uint32_t>(start));
+        }
+
+        starts.push_back(static_cast<uint32_t>(text.size()));
+    }
+
+   private:
+    std::pmr::unordered_map<std::basic_string_view<T>, char32_t> clusters_;
+};
+
+}  // namespace tpr
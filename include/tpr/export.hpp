@@ -0,0 +1,321 @@
+#pragma once
+
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "alignment.hpp"
+#include "arena.hpp"
+#include "input.hpp"
+#include "mapped_file.hpp"
+#include "replay.hpp"
+
+namespace tpr {
+
+// Machine readable results, one line per test.
+enum class ExportFormat {
+    jsonl,
+    csv,
+};
+
+inline auto export_format(std::string_view name) noexcept -> ExportFormat {
+    return name == "csv" ? ExportFormat::csv : ExportFormat::jsonl;
+}
+
+// One scored test as it is exported.
+struct TestResult {
+    uint64_t seed = 0;
+    int64_t time = 0;         // nanoseconds since the unix epoch
+    uint64_t characters = 0;  // typed, as counted for the speeds
+    std::chrono::nanoseconds duration{};
+    Score score;
+    std::span<const uint64_t> words;  // nanoseconds spent on every word
+};
+
+// Time spent on every typed word: from the end of the previous word, or
+// the first keystroke, to the space typed after it, or the last keystroke
+// for the last word. Corrections count toward the word they were made in.
+// `keys[i]` is the `i`-th of `count` keystrokes.
+template <class Keys>
+auto word_times(const Keys& keys, std::size_t count,
+                std::pmr::vector<uint64_t>& out) -> void {
+    out.clear();
+
+    if (not count) {
+        return;
+    }
+
+    uint64_t start = keys[0].time;
+    bool in_word = false;
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto key = keys[i];
+        const auto c = static_cast<unsigned char>(key.key);
+
+        if (c == ' ') {
+            if (in_word) {
+                out.push_back(key.time - start);
+                start = key.time;
+                in_word = false;
+            }
+        } else if (c >= 0x20 and c != key_backspace) {
+            in_word = true;
+        }
+    }
+
+    if (in_word) {
+        out.push_back(keys[count - 1].time - start);
+    }
+}
+
+// Column names of the csv export, in the order of the json fields.
+inline auto append_csv_header(fmt::memory_buffer& out) -> void {
+    constexpr std::string_view header =
+        "seed,time,characters,duration_us,wpm,cpm,wps,cps,errors,wrong,"
+        "extra,missed,wrong_words,word_us\n";
+
+    out.append(header.data(), header.data() + header.size());
+}
+
+// Appends `result` as one line of `format` to `out`. Fields are formatted
+// straight into the buffer from compiled format strings, nothing is
+// allocated but the buffer growing. Speeds are those of --measure-units,
+// durations are whole microseconds. Per word times are a json array or a
+// space separated csv field.
+inline auto append_result(const TestResult& result, ExportFormat format,
+                          fmt::memory_buffer& out) -> void {
+    const auto to = std::back_inserter(out);
+
+    // every unit is a multiple of characters per second
+    const auto cps = typing_speed(result.characters, result.duration, "cps");
+    const auto wps = cps / 5.0;
+
+    const auto& characters = result.score.characters;
+    const auto micros = result.duration.count() / 1000;
+
+    if (format == ExportFormat::jsonl) {
+        fmt::format_to(to,
+                       FMT_COMPILE("{{\"seed\":{},\"time\":{},"
+                                   "\"characters\":{},\"duration_us\":{},"
+                                   "\"wpm\":{:.2f},\"cpm\":{:.2f},"
+                                   "\"wps\":{:.3f},\"cps\":{:.3f},"
+                                   "\"errors\":{},\"wrong\":{},\"extra\":{},"
+                                   "\"missed\":{},\"wrong_words\":{},"
+                                   "\"word_us\":["),
+                       result.seed, result.time, result.characters, micros,
+                       wps * 60.0, cps * 60.0, wps, cps, characters.total(),
+                       characters.substitutions, characters.insertions,
+                       characters.deletions, result.score.words.total());
+    } else {
+        fmt::format_to(to,
+                       FMT_COMPILE("{},{},{},{},{:.2f},{:.2f},{:.3f},{:.3f},"
+                                   "{},{},{},{},{},"),
+                       result.seed, result.time, result.characters, micros,
+                       wps * 60.0, cps * 60.0, wps, cps, characters.total(),
+                       characters.substitutions, characters.insertions,
+                       characters.deletions, result.score.words.total());
+    }
+
+    const char separator = format == ExportFormat::jsonl ? ',' : ' ';
+
+    for (std::size_t i = 0; i < result.words.size(); ++i) {
+        if (i) {
+            out.push_back(separator);
+        }
+
+        fmt::format_to(to, FMT_COMPILE("{}"), result.words[i] / 1000);
+    }
+
+    if (format == ExportFormat::jsonl) {
+        constexpr std::string_view end = "]}\n";
+        out.append(end.data(), end.data() + end.size());
+    } else {
+        out.push_back('\n');
+    }
+}
+
+// Scores a logged session like --replay does and appends its result.
+template <class Encoding>
+auto append_session(const LoggedSession& session, ExportFormat format,
+                    std::pmr::memory_resource* resource,
+                    fmt::memory_buffer& out) -> void {
+    std::pmr::vector<uint64_t> words(resource);
+    word_times(session, session.header.keystrokes, words);
+
+    append_result(
+        {
+            .seed = session.header.seed,
+            .time = session.header.time,
+            .characters = encoding_traits<Encoding>::length(session.typed),
+            .duration = session.duration(),
+            .score = score<char, Encoding>(session.text, session.typed,
+                                           resource),
+            .words = words,
+        },
+        format, out);
+}
+
+inline auto append_session(const LoggedSession& session, ExportFormat format,
+                           std::pmr::memory_resource* resource,
+                           fmt::memory_buffer& out) -> void {
+    if (is_ascii(std::span(session.text)) and
+        is_ascii(std::span(session.typed))) {
+        append_session<Ascii>(session, format, resource, out);
+    } else {
+        append_session<Utf8>(session, format, resource, out);
+    }
+}
+
+// Appends one result to the file at `path`, '-' for stdout. A new csv
+// file starts with its header.
+inline auto export_result(const std::string& path, const TestResult& result,
+                          ExportFormat format) -> bool {
+    const bool to_stdout = path == "-";
+
+    std::FILE* file = to_stdout ? stdout : std::fopen(path.c_str(), "ab");
+
+    if (not file) {
+        return false;
+    }
+
+    fmt::memory_buffer out;
+
+    if (format == ExportFormat::csv and
+        (to_stdout or
+         (std::fseek(file, 0, SEEK_END) == 0 and std::ftell(file) == 0))) {
+        append_csv_header(out);
+    }
+
+    append_result(result, format, out);
+
+    const bool written =
+        std::fwrite(out.data(), 1, out.size(), file) == out.size();
+
+    return (to_stdout ? std::fflush(file) == 0 : std::fclose(file) == 0) and
+           written;
+}
+
+struct ExportSummary {
+    uint64_t sessions = 0;
+    uint64_t bytes = 0;
+    bool truncated = false;  // reading stopped at a malformed record
+    bool written = true;     // every block reached the file
+};
+
+// Writes the result of every session of `log` to `file`, in log order.
+// Workers format whole chunks of sessions into buffers of their own and
+// take turns writing them in the order the chunks were read, so the file
+// gets one large write per chunk and no lock is held while formatting.
+// Nullopt if `log` is not a session log.
+inline auto export_sessions(const MappedFile& log, unsigned threads,
+                            ExportFormat format, std::FILE* file)
+    -> std::optional<ExportSummary> {
+    LogReader reader(log.bytes());
+
+    if (not reader.valid()) {
+        return std::nullopt;
+    }
+
+    threads = std::max(threads, 1u);
+
+    ExportSummary summary;
+
+    if (format == ExportFormat::csv) {
+        fmt::memory_buffer header;
+        append_csv_header(header);
+
+        summary.bytes = header.size();
+        summary.written =
+            std::fwrite(header.data(), 1, header.size(), file) ==
+            header.size();
+    }
+
+    std::mutex reading;
+    uint64_t chunks_read = 0;
+
+    std::mutex writing;
+    std::condition_variable turn;
+    uint64_t chunks_written = 0;
+
+    const auto work = [&] {
+        ThreadArena arena(scoring_arena_size);
+
+        std::vector<LoggedSession> chunk(replay_chunk_size);
+        fmt::memory_buffer out;
+
+        for (;;) {
+            std::size_t size = 0;
+            uint64_t ticket = 0;
+
+            {
+                const std::lock_guard lock(reading);
+
+                while (size < chunk.size() and reader.next(chunk[size])) {
+                    ++size;
+                }
+
+                ticket = chunks_read;
+                chunks_read += size ? 1 : 0;
+            }
+
+            if (not size) {
+                return;
+            }
+
+            out.clear();
+
+            for (std::size_t i = 0; i < size; ++i) {
+                append_session(chunk[i], format, arena.resource(), out);
+                arena.reset();
+            }
+
+            {
+                std::unique_lock lock(writing);
+                turn.wait(lock, [&] { return chunks_written == ticket; });
+
+                summary.written =
+                    summary.written and
+                    std::fwrite(out.data(), 1, out.size(), file) == out.size();
+                summary.sessions += size;
+                summary.bytes += out.size();
+
+                ++chunks_written;
+            }
+
+            turn.notify_all();
+        }
+    };
+
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(threads - 1);
+
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back(work);
+        }
+
+        work();
+    }
+
+    summary.truncated = reader.truncated();
+    summary.written = summary.written and std::fflush(file) == 0;
+
+    return summary;
+}
+
+}  // namespace tpr
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <ranges>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "length_index.hpp"
+#include "profile.hpp"
+#include "random.hpp"
+#include "sampling.hpp"
+
+namespace tpr {
+
+// Parameters of a single test, zero length bounds are ignored.
+struct TestConfig {
+    uint64_t amount = 25;
+    uint64_t top = 200;
+    uint64_t min_length = 2;
+    uint64_t max_length = 0;
+    bool weighted = false;
+};
+
+// Appends word indices of a test to `out`. Uniform picks are distinct and
+// appended in frequency order, weighted picks are appended in draw order.
+template <class URBG>
+auto sample_words(const Candidates& candidates, const TestConfig& config,
+                  URBG& rng, std::pmr::vector<uint32_t>& out) -> void {
+    TPR_PROFILE_SCOPE(sampling);
+
+    if (config.weighted and not candidates.empty()) {
+        const RankSampler sampler(candidates, out.get_allocator());
+
+        out.reserve(out.size() + config.amount);
+        std::ranges::generate_n(std::back_inserter(out), config.amount,
+                                [&] { return sampler(rng); });
+        return;
+    }
+
+    const auto first = out.size();
+    floyd_sample(candidates.size(), config.amount, rng, out);
+
+    // buckets are grouped by length, sort to get frequency order
+    for (auto& position : out | std::views::drop(first)) {
+        position = candidates[position];
+    }
+
+    std::ranges::sort(out | std::views::drop(first));
+}
+
+// Joins `words` with single spaces. The exact size is known from the
+// length table, so the result is allocated once from `allocator`.
+template <class T>
+auto assemble_test(const Dictionary<T>& dictionary,
+                   std::span<const uint32_t> words,
+                   const std::pmr::polymorphic_allocator<std::type_identity_t<T>>&
+                       allocator) -> std::pmr::basic_string<T> {
+    TPR_PROFILE_SCOPE(assembly);
+
+    std::pmr::basic_string<T> test(allocator);
+
+    if (words.empty()) {
+        return test;
+    }
+
+    std::size_t size = words.size() - 1;
+
+    for (const auto word : words) {
+        size += dictionary.length(word);
+    }
+
+    test.reserve(size);
+    test.append(dictionary[words.front()]);
+
+    for (const auto word : words.subspan(1)) {
+        test.push_back(T(' '));
+        test.append(dictionary[word]);
+    }
+
+    return test;
+}
+
+// Space separated test built from the sampled words, empty if no word
+// matches the config. Every allocation goes through `allocator`, so with
+// a monotonic arena reset between tests generation does not touch the
+// global heap.
+template <class T, class URBG>
+auto generate_test(const Dictionary<T>& dictionary, const LengthIndex& index,
+                   const TestConfig& config, URBG& rng,
+                   const std::pmr::polymorphic_allocator<std::type_identity_t<T>>&
+                       allocator) -> std::pmr::basic_string<T> {
+    const auto candidates =
+        index.query(config.min_length, config.max_length, config.top);
+
+    std::pmr::vector<uint32_t> sampled(allocator);
+    sample_words(candidates, config, rng, sampled);
+
+    return assemble_test(dictionary, sampled, allocator);
+}
+
+// Owns a dictionary, its indices and a random engine. Generating a test
+// does no I/O and, for a fixed seed, always yields the same sequence of
+// tests.
+template <class T, class Engine = Xoshiro256>
+class TestGenerator {
+   public:
+    using engine_type = Engine;
+    using char_type = T;
+    using string = std::pmr::basic_string<T>;
+    using allocator_type = std::pmr::polymorphic_allocator<T>;
+
+    TestGenerator(Dictionary<T> dictionary, uint64_t seed,
+                  const allocator_type& allocator = {})
+        : dictionary_(std::move(dictionary)),
+          index_(dictionary_, allocator),
+          engine_(make_engine<Engine>(seed)),
+          allocator_(allocator) {}
+
+    // Generator over an index built beforehand, e.g. loaded from a cache.
+    TestGenerator(Dictionary<T> dictionary, LengthIndex index, uint64_t seed,
+                  const allocator_type& allocator = {})
+        : dictionary_(std::move(dictionary)),
+          index_(std::move(index)),
+          engine_(make_engine<Engine>(seed)),
+          allocator_(allocator) {}
+
+    auto seed(uint64_t seed, uint64_t stream = 0) -> void {
+        engine_ = make_engine<Engine>(seed, stream);
+    }
+
+    auto generate(const TestConfig& config) -> string {
+        return generate(config, engine_, allocator_);
+    }
+
+    // Thread safe as long as every caller brings its own engine.
+    auto generate(const TestConfig& config, Engine& engine,
+                  const allocator_type& allocator) const -> string {
+        return generate_test(dictionary_, index_, config, engine, allocator);
+    }
+
+    [[nodiscard]] auto dictionary() const noexcept -> const Dictionary<T>& {
+        return dictionary_;
+    }
+
+    [[nodiscard]] auto index() const noexcept -> const LengthIndex& {
+        return index_;
+    }
+
+    [[nodiscard]] auto engine() noexcept -> Engine& { return engine_; }
+
+   private:
+    Dictionary<T> dictionary_;
+    LengthIndex index_;
+    Engine engine_;
+    allocator_type allocator_;
+};
+
+}  // namespace tpr
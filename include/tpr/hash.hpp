@@ -0,0 +1,109 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace tpr {
+
+namespace detail {
+
+inline constexpr uint64_t xxh_prime1 = 0x9e3779b185ebca87;
+inline constexpr uint64_t xxh_prime2 = 0xc2b2ae3d27d4eb4f;
+inline constexpr uint64_t xxh_prime3 = 0x165667b19e3779f9;
+inline constexpr uint64_t xxh_prime4 = 0x85ebca77c2b2ae63;
+inline constexpr uint64_t xxh_prime5 = 0x27d4eb2f165667c5;
+
+inline auto xxh_read64(const std::byte* p) noexcept -> uint64_t {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return std::endian::native == std::endian::little ? value
+                                                      : std::byteswap(value);
+}
+
+inline auto xxh_read32(const std::byte* p) noexcept -> uint64_t {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return std::endian::native == std::endian::little ? value
+                                                      : std::byteswap(value);
+}
+
+inline auto xxh_round(uint64_t accumulator, uint64_t input) noexcept
+    -> uint64_t {
+    accumulator += input * xxh_prime2;
+    return std::rotl(accumulator, 31) * xxh_prime1;
+}
+
+inline auto xxh_merge(uint64_t accumulator, uint64_t value) noexcept
+    -> uint64_t {
+    accumulator ^= xxh_round(0, value);
+    return accumulator * xxh_prime1 + xxh_prime4;
+}
+
+}  // namespace detail
+
+// XXH64 of `bytes`, the same value as the reference implementation. Four
+// independent lanes consume 32 bytes per step, so hashing runs at memory
+// speed and a whole dictionary can be fingerprinted on every start.
+inline auto xxhash64(std::span<const std::byte> bytes,
+                     uint64_t seed = 0) noexcept -> uint64_t {
+    using namespace detail;
+
+    const auto* p = bytes.data();
+    const auto* const end = p + bytes.size();
+
+    uint64_t hash;
+
+    if (bytes.size() >= 32) {
+        uint64_t v1 = seed + xxh_prime1 + xxh_prime2;
+        uint64_t v2 = seed + xxh_prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - xxh_prime1;
+
+        for (; end - p >= 32; p += 32) {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+        }
+
+        hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) +
+               std::rotl(v4, 18);
+        hash = xxh_merge(hash, v1);
+        hash = xxh_merge(hash, v2);
+        hash = xxh_merge(hash, v3);
+        hash = xxh_merge(hash, v4);
+    } else {
+        hash = seed + xxh_prime5;
+    }
+
+    hash += bytes.size();
+
+    for (; end - p >= 8; p += 8) {
+        hash ^= xxh_round(0, xxh_read64(p));
+        hash = std::rotl(hash, 27) * xxh_prime1 + xxh_prime4;
+    }
+
+    if (end - p >= 4) {
+        hash ^= xxh_read32(p) * xxh_prime1;
+        hash = std::rotl(hash, 23) * xxh_prime2 + xxh_prime3;
+        p += 4;
+    }
+
+    for (; p < end; ++p) {
+        hash ^= static_cast<uint64_t>(*p) * xxh_prime5;
+        hash = std::rotl(hash, 11) * xxh_prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= xxh_prime2;
+    hash ^= hash >> 29;
+    hash *= xxh_prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+}  // namespace tpr
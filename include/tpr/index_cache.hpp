@@ -0,0 +1,311 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "bigram_index.hpp"
+#include "dictionary.hpp"
+#include "hash.hpp"
+#include "length_index.hpp"
+#include "mapped_file.hpp"
+#include "profile.hpp"
+
+namespace tpr {
+
+// Identifies the contents of a dictionary: the hash of its bytes and the
+// modification time of its file. Derived structures cached under one key
+// are only used with a dictionary of the same key.
+struct CacheKey {
+    uint64_t hash = 0;
+    int64_t mtime = 0;
+
+    friend auto operator==(const CacheKey&, const CacheKey&) -> bool = default;
+};
+
+// Cache file layout, all integers in native byte order:
+//
+//   CacheHeader | tables
+//
+// `words` is the size of the dictionary and sizes every table, the header
+// keeps tables of 8 byte values aligned.
+struct CacheHeader {
+    static constexpr uint32_t length_index = 0x31495054;  // "TPI1"
+    static constexpr uint32_t bigram_index = 0x31425054;  // "TPB1"
+    static constexpr uint32_t latencies = 0x314b5054;     // "TPK1"
+    // 2: length indices of UTF-8 dictionaries bucket code points
+    static constexpr uint32_t current_version = 2;
+
+    uint32_t magic = 0;
+    uint32_t version = current_version;
+    uint64_t words = 0;
+    CacheKey key;
+};
+
+static_assert(sizeof(CacheHeader) == 32);
+
+// Default cache directory: $XDG_CACHE_HOME/typer, ~/.cache/typer or
+// %LOCALAPPDATA%/typer on windows, empty if none is set.
+inline auto default_cache_directory() -> std::filesystem::path {
+#if defined(_WIN32)
+    if (const char* local = std::getenv("LOCALAPPDATA"); local and *local) {
+        return std::filesystem::path(local) / "typer";
+    }
+#else
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache and *cache) {
+        return std::filesystem::path(cache) / "typer";
+    }
+
+    if (const char* home = std::getenv("HOME"); home and *home) {
+        return std::filesystem::path(home) / ".cache" / "typer";
+    }
+#endif
+    return {};
+}
+
+// Directory of indices derived from one dictionary. Every structure has one
+// file named after the hash of the dictionary's absolute path, a file whose
+// key does not match the dictionary any more is rebuilt and overwritten, so
+// stale entries never pile up.
+class IndexCache {
+   public:
+    // Nullopt if the dictionary's modification time can not be read or the
+    // directory can not be created.
+    static auto open(const std::filesystem::path& directory,
+                     const std::filesystem::path& dictionary_path,
+                     const MappedFile& dictionary_file)
+        -> std::optional<IndexCache> {
+        std::error_code error;
+
+        const auto mtime =
+            std::filesystem::last_write_time(dictionary_path, error);
+        const auto absolute = std::filesystem::absolute(dictionary_path, error);
+
+        if (error or directory.empty()) {
+            return std::nullopt;
+        }
+
+        std::filesystem::create_directories(directory, error);
+
+        if (error) {
+            return std::nullopt;
+        }
+
+        const auto name = absolute.generic_u8string();
+
+        IndexCache cache;
+        cache.key_ = {
+            .hash = xxhash64(dictionary_file.bytes()),
+            .mtime = static_cast<int64_t>(mtime.time_since_epoch().count()),
+        };
+        cache.stem_ = directory / fmt::format(
+                                      "{:016x}", xxhash64(std::as_bytes(
+                                                     std::span(name))));
+
+        return cache;
+    }
+
+    [[nodiscard]] auto key() const noexcept -> const CacheKey& {
+        return key_;
+    }
+
+    [[nodiscard]] auto path(std::string_view extension) const
+        -> std::filesystem::path {
+        auto path = stem_;
+        path += extension;
+        return path;
+    }
+
+    // Maps the cache file `extension` if it holds a `magic` structure built
+    // from this dictionary with `words` words, the tables follow the header.
+    [[nodiscard]] auto read(std::string_view extension, uint32_t magic,
+                            uint64_t words) const -> std::optional<MappedFile> {
+        auto file = MappedFile::open(path(extension));
+
+        if (not file or file->size() < sizeof(CacheHeader)) {
+            return std::nullopt;
+        }
+
+        CacheHeader header;
+        std::memcpy(&header, file->bytes().data(), sizeof(header));
+
+        if (header.magic != magic or
+            header.version != CacheHeader::current_version or
+            header.words != words or header.key != key_) {
+            return std::nullopt;
+        }
+
+        return file;
+    }
+
+    // Writes a cache file next to its final name and renames it over, so
+    // a concurrent reader never maps a half written file. The temporary
+    // name has a random suffix, so writers of the same file, in other
+    // processes or threads, never write into each other's.
+    auto write(std::string_view extension, uint32_t magic, uint64_t words,
+               std::initializer_list<std::span<const std::byte>> tables) const
+        -> bool {
+        const auto target = path(extension);
+        auto temporary = target;
+        temporary += fmt::format(".{:08x}{:08x}.tmp", std::random_device{}(),
+                                 std::random_device{}());
+
+        {
+            std::ofstream stream(temporary, std::ios::out | std::ios::binary);
+
+            const CacheHeader header{
+                .magic = magic,
+                .words = words,
+                .key = key_,
+            };
+
+            stream.write(reinterpret_cast<const char*>(&header),
+                         sizeof(header));
+
+            for (const auto table : tables) {
+                stream.write(reinterpret_cast<const char*>(table.data()),
+                             static_cast<std::streamsize>(table.size()));
+            }
+
+            if (not stream.flush()) {
+                stream.close();
+
+                std::error_code ignored;
+                std::filesystem::remove(temporary, ignored);
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary, target, error);
+
+        if (error) {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+        }
+
+        return not error;
+    }
+
+   private:
+    IndexCache() = default;
+
+    CacheKey key_;
+    std::filesystem::path stem_;
+};
+
+// Length index of `dictionary` over the characters of `Encoding` from the
+// cache, built and stored there on a miss. Without a cache it is just
+// built. The encoding follows from the dictionary's contents, so one key
+// never sees two encodings.
+//
+//   CacheHeader | double weights[words] | uint32_t buckets[bucket_count] |
+//   uint32_t indices[words]
+template <class Encoding = Ascii, class T>
+auto cached_length_index(const IndexCache* cache,
+                         const Dictionary<T>& dictionary,
+                         const LengthIndex::allocator_type& allocator = {})
+    -> LengthIndex {
+    TPR_PROFILE_SCOPE(index_build);
+
+    constexpr std::string_view extension = ".tpi";
+
+    const uint64_t words = dictionary.size();
+    const uint64_t size = words * (sizeof(double) + sizeof(uint32_t)) +
+                          LengthIndex::bucket_count * sizeof(uint32_t);
+
+    if (not cache) {
+        return make_length_index<Encoding>(dictionary, allocator);
+    }
+
+    if (auto file = cache->read(extension, CacheHeader::length_index, words);
+        file and file->size() == sizeof(CacheHeader) + size) {
+        const auto* tables = file->bytes().data() + sizeof(CacheHeader);
+
+        const auto* weights = reinterpret_cast<const double*>(tables);
+        const auto* buckets = reinterpret_cast<const uint32_t*>(
+            tables + words * sizeof(double));
+        const auto* indices = buckets + LengthIndex::bucket_count;
+
+        LengthIndex cached(std::move(*file),
+                           std::span{buckets, LengthIndex::bucket_count},
+                           std::span{indices, words}, std::span{weights, words});
+
+        // a corrupt or foreign file is rebuilt and overwritten
+        if (cached.valid(words)) {
+            return cached;
+        }
+    }
+
+    auto index = make_length_index<Encoding>(dictionary, allocator);
+
+    cache->write(extension, CacheHeader::length_index, words,
+                 {std::as_bytes(index.weights()), std::as_bytes(index.buckets()),
+                  std::as_bytes(index.indices())});
+
+    return index;
+}
+
+// Bigram index of `dictionary` from the cache, built and stored there on a
+// miss. Without a cache it is just built.
+//
+//   CacheHeader | uint32_t offsets[bigram_count + 1] | uint32_t words[...]
+template <class T>
+auto cached_bigram_index(const IndexCache* cache,
+                         const Dictionary<T>& dictionary,
+                         const BigramIndex::allocator_type& allocator = {})
+    -> BigramIndex {
+    TPR_PROFILE_SCOPE(index_build);
+
+    constexpr std::string_view extension = ".tpb";
+    constexpr auto offsets_size =
+        (BigramIndex::bigram_count + 1) * sizeof(uint32_t);
+
+    const uint64_t words = dictionary.size();
+
+    if (not cache) {
+        return BigramIndex(dictionary, allocator);
+    }
+
+    if (auto file = cache->read(extension, CacheHeader::bigram_index, words);
+        file and file->size() >= sizeof(CacheHeader) + offsets_size) {
+        const auto* offsets = reinterpret_cast<const uint32_t*>(
+            file->bytes().data() + sizeof(CacheHeader));
+        const uint64_t entries = offsets[BigramIndex::bigram_count];
+
+        if (file->size() ==
+            sizeof(CacheHeader) + offsets_size + entries * sizeof(uint32_t)) {
+            BigramIndex cached(
+                std::move(*file),
+                std::span{offsets, BigramIndex::bigram_count + 1},
+                std::span{offsets + BigramIndex::bigram_count + 1, entries});
+
+            // a corrupt or foreign file is rebuilt and overwritten
+            if (cached.valid(words)) {
+                return cached;
+            }
+        }
+    }
+
+    BigramIndex index(dictionary, allocator);
+
+    cache->write(extension, CacheHeader::bigram_index, words,
+                 {std::as_bytes(index.offsets()),
+                  std::as_bytes(index.entries())});
+
+    return index;
+}
+
+}  // namespace tpr
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "encoding.hpp"
+#include "profile.hpp"
+#include "terminal.hpp"
+
+namespace tpr {
+
+struct Keystroke {
+    uint64_t time;  // nanoseconds since the prompt was shown
+    char key;
+};
+
+inline constexpr char key_interrupt = 0x03;  // ctrl-c
+inline constexpr char key_eof = 0x04;        // ctrl-d
+inline constexpr char key_backspace = 0x7f;
+inline constexpr char key_erase = 0x08;  // ctrl-h, backspace on windows
+inline constexpr char key_enter = '\r';
+inline constexpr char key_newline = '\n';
+inline constexpr char key_escape = 0x1b;
+
+// Bytes of an escape sequence arrive together, one not arriving within
+// this time means escape was pressed on its own.
+inline constexpr std::chrono::milliseconds escape_sequence_timeout{25};
+
+// Fixed capacity ring of keystrokes allocated once before typing starts,
+// once full the oldest keystrokes are overwritten. The first keystroke
+// is kept apart and never overwritten, so the typing time from the first
+// to the last keystroke stays exact however many keys were pressed.
+class KeystrokeBuffer {
+   public:
+    using allocator_type = std::pmr::polymorphic_allocator<Keystroke>;
+
+    explicit KeystrokeBuffer(std::size_t capacity,
+                             const allocator_type& allocator = {})
+        : keys_(std::bit_ceil(std::max<std::size_t>(capacity, 2) - 1),
+                Keystroke{}, allocator) {}
+
+    auto push(const Keystroke& keystroke) noexcept -> void {
+        if (pushed_++ == 0) {
+            first_ = keystroke;
+        } else {
+            keys_[(pushed_ - 2) & (keys_.size() - 1)] = keystroke;
+        }
+    }
+
+    auto clear() noexcept -> void { pushed_ = 0; }
+
+    [[nodiscard]] auto size() const noexcept {
+        return std::min<std::size_t>(pushed_, capacity());
+    }
+    [[nodiscard]] auto empty() const noexcept { return pushed_ == 0; }
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+        return keys_.size() + 1;
+    }
+
+    // Number of keystrokes pushed since the last clear, including the
+    // overwritten ones.
+    [[nodiscard]] auto pushed() const noexcept { return pushed_; }
+
+    // `i`-th oldest keystroke still held, the first one pushed and then the
+    // latest `size() - 1`. Once keys were overwritten, the gap between the
+    // first two spans them.
+    [[nodiscard]] auto operator[](std::size_t i) const noexcept
+        -> const Keystroke& {
+        if (i == 0) {
+            return first_;
+        }
+
+        return keys_[(pushed_ - size() + i - 1) & (keys_.size() - 1)];
+    }
+
+    [[nodiscard]] auto front() const noexcept -> const Keystroke& {
+        return (*this)[0];
+    }
+    [[nodiscard]] auto back() const noexcept -> const Keystroke& {
+        return (*this)[size() - 1];
+    }
+
+   private:
+    Keystroke first_{};
+    std::pmr::vector<Keystroke> keys_;  // every keystroke after the first
+    std::size_t pushed_ = 0;
+};
+
+// Default echo for raw input, mirrors the line editing of a cooked
+// terminal.
+struct PlainEcho {
+    auto operator()(std::string_view /*typed*/, char key) const -> void {
+        if (key == key_backspace or key == key_erase) {
+            std::fputs("\b \b", stdout);
+        } else {
+            std::fputc(key, stdout);
+        }
+
+        std::fflush(stdout);
+    }
+};
+
+// Consumes the rest of an escape sequence after its escape byte, e.g. the
+// "[A" of the up arrow or "OP" of F1. Escape followed by any other byte is
+// alt and that key, which is consumed too.
+inline auto skip_escape_sequence(const RawTerminal& terminal) -> void {
+    const auto introducer = terminal.read(escape_sequence_timeout);
+
+    if (introducer == 'O') {
+        terminal.read(escape_sequence_timeout);
+        return;
+    }
+
+    if (introducer != '[') {
+        return;
+    }
+
+    // parameter and intermediate bytes up to the final byte
+    for (auto c = terminal.read(escape_sequence_timeout); c;
+         c = terminal.read(escape_sequence_timeout)) {
+        if (*c < 0x20 or *c >= 0x40) {
+            return;
+        }
+    }
+}
+
+// Reads a line key by key, timestamping every key press (backspace and
+// enter included) into `keystrokes` and keeping the edited text in `typed`.
+// Escape sequences of arrows and function keys are skipped and are not
+// recorded. Backspace erases a whole character of `Encoding`, every code
+// unit of it. `echo(typed, key)` is called after each key is applied.
+// Returns false if the user interrupted the input or it ended before
+// enter.
+template <class Encoding = Ascii, class T, class Echo = PlainEcho>
+auto capture_input(const RawTerminal& terminal, KeystrokeBuffer& keystrokes,
+                   std::pmr::basic_string<T>& typed, Echo&& echo = {})
+    -> bool {
+    namespace chr = std::chrono;
+
+    TPR_PROFILE_SCOPE(input);
+
+    const auto start = chr::steady_clock::now();
+
+    for (auto key = terminal.read(); key; key = terminal.read()) {
+        if (*key == key_escape) {
+            skip_escape_sequence(terminal);
+            continue;
+        }
+
+        const auto time = chr::duration_cast<chr::nanoseconds>(
+            chr::steady_clock::now() - start);
+        keystrokes.push({static_cast<uint64_t>(time.count()), *key});
+
+        if (*key == key_interrupt or *key == key_eof) {
+            return false;
+        }
+
+        if (*key == key_enter or *key == key_newline) {
+            return true;
+        }
+
+        if (*key == key_backspace or *key == key_erase) {
+            if (typed.empty()) {
+                continue;
+            }
+
+            typed.resize(encoding_traits<Encoding>::last(
+                std::basic_string_view<T>(typed)));
+        } else if (static_cast<unsigned char>(*key) < 0x20) {
+            continue;
+        } else {
+            typed.push_back(T(*key));
+        }
+
+        echo(std::basic_string_view<T>(typed), *key);
+    }
+
+    return false;
+}
+
+// Typing time from the first to the last keystroke.
+inline auto typing_duration(const KeystrokeBuffer& keystrokes) noexcept
+    -> std::chrono::nanoseconds {
+    if (keystrokes.empty()) {
+        return {};
+    }
+
+    return std::chrono::nanoseconds(keystrokes.back().time -
+                                    keystrokes.front().time);
+}
+
+// Speed in one of the --measure-units, a word is 5 characters.
+inline auto typing_speed(std::size_t characters,
+                         std::chrono::nanoseconds duration,
+                         std::string_view unit) noexcept -> double {
+    const auto seconds = std::chrono::duration<double>(duration).count();
+
+    if (seconds <= 0.0) {
+        return 0.0;
+    }
+
+    const double words = static_cast<double>(characters) / 5.0;
+
+    if (unit == "cpm") {
+        return static_cast<double>(characters) * 60.0 / seconds;
+    }
+
+    if (unit == "cps") {
+        return static_cast<double>(characters) / seconds;
+    }
+
+    if (unit == "wps") {
+        return words / seconds;
+    }
+
+    return words * 60.0 / seconds;
+}
+
+}  // namespace tpr
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace tpr {
+
+// Log bucketed histogram of key latencies in the spirit of HDR histograms:
+// microseconds are grouped by their power of two and every power is split
+// into `sub_buckets` linear buckets, so any recorded value is known within
+// 1 / sub_buckets (12.5%) while memory stays constant. Latencies above
+// `max_latency` land in the last bucket.
+class LatencyHistogram {
+   public:
+    static constexpr unsigned sub_bits = 3;
+    static constexpr uint64_t sub_buckets = uint64_t{1} << sub_bits;
+    static constexpr uint64_t max_latency = (uint64_t{1} << 24) - 1;  // us
+
+    static constexpr std::size_t bucket_count =
+        (std::bit_width(max_latency) - sub_bits) * sub_buckets + sub_buckets;
+
+    auto record(std::chrono::nanoseconds latency) noexcept -> void {
+        const auto micros = static_cast<uint64_t>(
+            std::max<int64_t>(latency.count() / 1000, 0));
+
+        ++counts_[bucket(std::min(micros, max_latency))];
+        ++total_;
+    }
+
+    auto merge(const LatencyHistogram& other) noexcept -> void {
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+
+        total_ += other.total_;
+    }
+
+    [[nodiscard]] auto count() const noexcept { return total_; }
+    [[nodiscard]] auto empty() const noexcept { return total_ == 0; }
+
+    // Latency below which `fraction` of the recorded latencies lie, the
+    // middle of the bucket holding that rank.
+    [[nodiscard]] auto quantile(double fraction) const noexcept
+        -> std::chrono::nanoseconds {
+        const auto rank = static_cast<uint64_t>(
+            std::clamp(fraction, 0.0, 1.0) * static_cast<double>(total_));
+        uint64_t seen = 0;
+
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += counts_[i];
+
+            if (seen > rank) {
+                return std::chrono::microseconds((lowest(i) + highest(i)) / 2);
+            }
+        }
+
+        return std::chrono::microseconds(max_latency);
+    }
+
+   private:
+    static constexpr auto bucket(uint64_t micros) noexcept -> std::size_t {
+        if (micros < sub_buckets) {
+            return static_cast<std::size_t>(micros);
+        }
+
+        const auto shift = static_cast<unsigned>(std::bit_width(micros)) -
+                           sub_bits - 1;
+
+        return static_cast<std::size_t>(shift * sub_buckets +
+                                        (micros >> shift));
+    }
+
+    static constexpr auto lowest(std::size_t index) noexcept -> uint64_t {
+        if (index < 2 * sub_buckets) {
+            return index;
+        }
+
+        const auto shift = index / sub_buckets - 1;
+        return (index - shift * sub_buckets) << shift;
+    }
+
+    static constexpr auto highest(std::size_t index) noexcept -> uint64_t {
+        return index + 1 < bucket_count ? lowest(index + 1) - 1 : max_latency;
+    }
+
+    std::array<uint64_t, bucket_count> counts_{};
+    uint64_t total_ = 0;
+};
+
+// Histograms are stored and read back as they lie in memory.
+static_assert(std::is_trivially_copyable_v<LatencyHistogram>);
+
+// Latency histograms of every key and of every bigram typed, the latency
+// of a key being the time since the previous key press. Keys have a fixed
+// table, bigrams are only allocated once seen. Recording is a table or
+// hash lookup and an increment, cheap enough for every keystroke.
+class KeyLatencies {
+   public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+    using Bigrams = std::pmr::unordered_map<uint16_t, LatencyHistogram>;
+
+    explicit KeyLatencies(const allocator_type& allocator = {})
+        : bigrams_(allocator) {}
+
+    static constexpr auto bigram(char previous, char key) noexcept
+        -> uint16_t {
+        const auto high = static_cast<unsigned char>(previous);
+        const auto low = static_cast<unsigned char>(key);
+
+        return static_cast<uint16_t>(high << 8 | low);
+    }
+
+    // Records `key` typed `latency` after `previous`.
+    auto record(char previous, char key,
+                std::chrono::nanoseconds latency) -> void {
+        overall_.record(latency);
+        keys_[static_cast<unsigned char>(key)].record(latency);
+        bigrams_[bigram(previous, key)].record(latency);
+    }
+
+    // Records the printable keys of a typing session, `keys[i]` having a
+    // `time` in nanoseconds and a `key`. Keys typed right after a control
+    // key (a correction, enter) are skipped, their latency is mostly the
+    // pause of noticing a mistake.
+    template <class Keys>
+    auto add(const Keys& keys, std::size_t size) -> void {
+        for (std::size_t i = 1; i < size; ++i) {
+            const auto& previous = keys[i - 1];
+            const auto& current = keys[i];
+
+            if (not printable(previous.key) or not printable(current.key)) {
+                continue;
+            }
+
+            record(static_cast<char>(previous.key),
+                   static_cast<char>(current.key),
+                   std::chrono::nanoseconds(current.time - previous.time));
+        }
+    }
+
+    auto merge(const KeyLatencies& other) -> void {
+        overall_.merge(other.overall_);
+
+        for (std::size_t i = 0; i < keys_.size(); ++i) {
+            keys_[i].merge(other.keys_[i]);
+        }
+
+        for (const auto& [pair, histogram] : other.bigrams_) {
+            bigrams_[pair].merge(histogram);
+        }
+    }
+
+    [[nodiscard]] auto overall() const noexcept -> const LatencyHistogram& {
+        return overall_;
+    }
+
+    [[nodiscard]] auto key(char c) const noexcept -> const LatencyHistogram& {
+        return keys_[static_cast<unsigned char>(c)];
+    }
+
+    [[nodiscard]] auto bigrams() const noexcept -> const Bigrams& {
+        return bigrams_;
+    }
+
+    [[nodiscard]] auto keys() const noexcept
+        -> std::span<const LatencyHistogram, 256> {
+        return keys_;
+    }
+
+    // Histograms to fill in place, e.g. from a stored checkpoint.
+    [[nodiscard]] auto overall() noexcept -> LatencyHistogram& {
+        return overall_;
+    }
+
+    [[nodiscard]] auto keys() noexcept -> std::span<LatencyHistogram, 256> {
+        return keys_;
+    }
+
+    [[nodiscard]] auto bigrams() noexcept -> Bigrams& { return bigrams_; }
+
+   private:
+    static constexpr auto printable(auto key) noexcept {
+        const auto byte = static_cast<unsigned char>(key);
+        return byte >= 0x20 and byte != 0x7f;
+    }
+
+    LatencyHistogram overall_;
+    std::array<LatencyHistogram, 256> keys_{};
+    Bigrams bigrams_;
+};
+
+// Keys and bigrams typed fewer times are left out of the rankings, their
+// percentiles say little.
+inline constexpr uint64_t min_ranked_samples = 8;
+
+// Appends the latency percentiles of all keys plus the `limit` slowest
+// keys and bigrams, ranked by their median, to `out`.
+inline auto render_latencies(const KeyLatencies& latencies, std::size_t limit,
+                             fmt::memory_buffer& out) -> void {
+    namespace chr = std::chrono;
+
+    const auto to = std::back_inserter(out);
+
+    const auto ms = [](chr::nanoseconds latency) {
+        return chr::duration<double, std::milli>(latency).count();
+    };
+
+    const auto row = [&](std::string_view name,
+                         const LatencyHistogram& histogram) {
+        fmt::format_to(to, "  {:<6} {:>9} {:>9.1f} {:>9.1f} {:>9.1f}\n",
+                       name, histogram.count(), ms(histogram.quantile(0.5)),
+                       ms(histogram.quantile(0.9)),
+                       ms(histogram.quantile(0.99)));
+    };
+
+    const auto header = [&](std::string_view name) {
+        fmt::format_to(to, "\n  {:<6} {:>9} {:>9} {:>9} {:>9}\n", name,
+                       "count", "p50 ms", "p90 ms", "p99 ms");
+    };
+
+    struct Ranked {
+        chr::nanoseconds median;
+        uint16_t id;
+        const LatencyHistogram* histogram;
+    };
+
+    // medians are computed once, not in every comparison
+    const auto rank = [limit](std::vector<Ranked>& ranked) {
+        std::ranges::sort(ranked, std::ranges::greater{}, &Ranked::median);
+        ranked.resize(std::min(ranked.size(), limit));
+    };
+
+    const auto ranked = [](uint16_t id, const LatencyHistogram& histogram) {
+        return Ranked{histogram.quantile(0.5), id, &histogram};
+    };
+
+    header("keys");
+    row("all", latencies.overall());
+
+    std::vector<Ranked> keys;
+
+    for (uint16_t c = 0; c < 256; ++c) {
+        const auto& histogram = latencies.key(static_cast<char>(c));
+
+        if (histogram.count() >= min_ranked_samples) {
+            keys.push_back(ranked(c, histogram));
+        }
+    }
+
+    rank(keys);
+
+    for (const auto& key : keys) {
+        const auto c = static_cast<char>(key.id);
+        row(c == ' ' ? std::string("' '") : std::string(1, c),
+            *key.histogram);
+    }
+
+    std::vector<Ranked> bigrams;
+
+    for (const auto& [pair, histogram] : latencies.bigrams()) {
+        if (histogram.count() >= min_ranked_samples) {
+            bigrams.push_back(ranked(pair, histogram));
+        }
+    }
+
+    rank(bigrams);
+    header("bigram");
+
+    for (const auto& bigram : bigrams) {
+        const char text[] = {static_cast<char>(bigram.id >> 8),
+                             static_cast<char>(bigram.id & 0xff)};
+        row(std::string_view(text, 2), *bigram.histogram);
+    }
+}
+
+}  // namespace tpr
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "encoding.hpp"
+#include "mapped_file.hpp"
+
+namespace tpr {
+
+// Words matching a length query: a union of contiguous bucket ranges of a
+// LengthIndex. `operator[]` maps a position in [0, size()) to a word index.
+class Candidates {
+   public:
+    static constexpr std::size_t max_ranges = max_word_length + 1;
+
+    auto push(std::span<const uint32_t> range,
+              std::span<const double> weights) noexcept -> void {
+        if (range.empty()) {
+            return;
+        }
+
+        ranges_[count_] = range;
+        weights_[count_] = weights;
+        ends_[count_] = size_ + range.size();
+        size_ = ends_[count_];
+        ++count_;
+    }
+
+    [[nodiscard]] auto size() const noexcept { return size_; }
+    [[nodiscard]] auto empty() const noexcept { return size_ == 0; }
+
+    [[nodiscard]] auto ranges() const noexcept {
+        return std::span{ranges_.data(), count_};
+    }
+
+    // Running sums of rank weights, parallel to `ranges()`.
+    [[nodiscard]] auto weights() const noexcept {
+        return std::span{weights_.data(), count_};
+    }
+
+    [[nodiscard]] auto operator[](std::size_t position) const noexcept
+        -> uint32_t {
+        const auto ends = std::span{ends_.data(), count_};
+        const auto range = static_cast<std::size_t>(
+            std::ranges::upper_bound(ends, position) - ends.begin());
+        const auto begin = range ? ends_[range - 1] : 0;
+
+        return ranges_[range][position - begin];
+    }
+
+   private:
+    std::array<std::span<const uint32_t>, max_ranges> ranges_{};
+    std::array<std::span<const double>, max_ranges> weights_{};
+    std::array<std::size_t, max_ranges> ends_{};
+    std::size_t count_ = 0;
+    std::size_t size_ = 0;
+};
+
+// Word indices grouped by length, one bucket per length. Buckets keep the
+// dictionary (frequency) order, so the `top` most frequent words of a
+// bucket are always its prefix. Every bucket also keeps running sums of the
+// Zipf rank weights `1 / (index + 1)` for frequency weighted sampling. The
+// tables are either built or point into a mapped cache file.
+class LengthIndex {
+   public:
+    static constexpr std::size_t bucket_count = max_word_length + 2;
+
+    using allocator_type = std::pmr::polymorphic_allocator<uint32_t>;
+
+    explicit LengthIndex(std::span<const uint8_t> lengths,
+                         const allocator_type& allocator = {})
+        : owned_buckets_(bucket_count, 0, allocator),
+          owned_indices_(lengths.size(), 0, allocator),
+          owned_weights_(lengths.size(), 0.0, allocator) {
+        for (const auto length : lengths) {
+            ++owned_buckets_[length + 1];
+        }
+
+        for (std::size_t i = 1; i < owned_buckets_.size(); ++i) {
+            owned_buckets_[i] += owned_buckets_[i - 1];
+        }
+
+        std::pmr::vector<uint32_t> cursor(owned_buckets_.begin(),
+                                          owned_buckets_.end() - 1, allocator);
+
+        for (std::size_t i = 0; i < lengths.size(); ++i) {
+            owned_indices_[cursor[lengths[i]]++] = static_cast<uint32_t>(i);
+        }
+
+        for (std::size_t length = 0; length <= max_word_length; ++length) {
+            double sum = 0.0;
+
+            for (auto i = owned_buckets_[length];
+                 i < owned_buckets_[length + 1]; ++i) {
+                sum += 1.0 / (static_cast<double>(owned_indices_[i]) + 1.0);
+                owned_weights_[i] = sum;
+            }
+        }
+
+        buckets_ = owned_buckets_;
+        indices_ = owned_indices_;
+        weights_ = owned_weights_;
+    }
+
+    template <class T>
+    explicit LengthIndex(const Dictionary<T>& dictionary,
+                         const allocator_type& allocator = {})
+        : LengthIndex(dictionary.lengths(), allocator) {}
+
+    // Index loaded from a cache file, all tables live in the mapping.
+    LengthIndex(MappedFile file, std::span<const uint32_t> buckets,
+                std::span<const uint32_t> indices,
+                std::span<const double> weights) noexcept
+        : file_(std::move(file)),
+          buckets_(buckets),
+          indices_(indices),
+          weights_(weights) {}
+
+    // Moving a vector keeps its buffer, so the spans stay valid.
+    LengthIndex(LengthIndex&&) noexcept = default;
+    auto operator=(LengthIndex&&) -> LengthIndex& = delete;
+
+    // Indices of all words of exactly `length` characters.
+    [[nodiscard]] auto bucket(std::size_t length) const noexcept
+        -> std::span<const uint32_t> {
+        if (length > max_word_length) {
+            return {};
+        }
+
+        return indices_.subspan(
+            buckets_[length], buckets_[length + 1] - buckets_[length]);
+    }
+
+    // Running sums of rank weights, parallel to `bucket(length)`.
+    [[nodiscard]] auto weights(std::size_t length) const noexcept
+        -> std::span<const double> {
+        if (length > max_word_length) {
+            return {};
+        }
+
+        return weights_.subspan(
+            buckets_[length], buckets_[length + 1] - buckets_[length]);
+    }
+
+    // Words among the first `top` ones with length in [min, max], zero
+    // bounds (and a zero `top`) are ignored just like the
+    // --min-length/--max-length flags.
+    [[nodiscard]] auto query(uint64_t min, uint64_t max, uint64_t top) const
+        noexcept -> Candidates {
+        Candidates candidates;
+
+        const auto last = max ? std::min<uint64_t>(max, max_word_length)
+                              : max_word_length;
+
+        for (uint64_t length = min; length <= last; ++length) {
+            const auto words = bucket(length);
+            const auto end = top ? std::ranges::lower_bound(words, top)
+                                 : words.end();
+
+            const auto size = static_cast<std::size_t>(end - words.begin());
+
+            candidates.push(words.first(size), weights(length).first(size));
+        }
+
+        return candidates;
+    }
+
+    // True if the tables index a dictionary of `words` words: the bucket
+    // starts begin at zero, never decrease and end at `words`, every index
+    // names a word and every weight is finite.
+    [[nodiscard]] auto valid(std::size_t words) const noexcept -> bool {
+        const auto named = [words](uint32_t index) { return index < words; };
+        const auto finite = [](double weight) { return std::isfinite(weight); };
+
+        return buckets_.size() == bucket_count and buckets_.front() == 0 and
+               buckets_.back() == words and indices_.size() == words and
+               weights_.size() == words and std::ranges::is_sorted(buckets_) and
+               std::ranges::all_of(indices_, named) and
+               std::ranges::all_of(weights_, finite);
+    }
+
+    // Raw tables: bucket starts, word indices grouped by length and their
+    // running rank weights.
+    [[nodiscard]] auto buckets() const noexcept { return buckets_; }
+    [[nodiscard]] auto indices() const noexcept { return indices_; }
+    [[nodiscard]] auto weights() const noexcept { return weights_; }
+
+   private:
+    MappedFile file_;
+    std::pmr::vector<uint32_t> owned_buckets_;
+    std::pmr::vector<uint32_t> owned_indices_;
+    std::pmr::vector<double> owned_weights_;
+    std::span<const uint32_t> buckets_;
+    std::span<const uint32_t> indices_;
+    std::span<const double> weights_;
+};
+
+// Length index over the characters of `Encoding`. Ascii lengths are the
+// dictionary's own length table, Utf8 lengths are counted in code points
+// once here, so --min-length and --max-length mean characters either way.
+template <class Encoding, class T>
+auto make_length_index(const Dictionary<T>& dictionary,
+                       const LengthIndex::allocator_type& allocator = {})
+    -> LengthIndex {
+    if constexpr (std::is_same_v<Encoding, Ascii>) {
+        return LengthIndex(dictionary, allocator);
+    } else {
+        std::pmr::vector<uint8_t> lengths(dictionary.size(), 0, allocator);
+
+        for (std::size_t i = 0; i < dictionary.size(); ++i) {
+            lengths[i] = static_cast<uint8_t>(
+                encoding_traits<Encoding>::length(dictionary[i]));
+        }
+
+        return LengthIndex(lengths, allocator);
+    }
+}
+
+}  // namespace tpr
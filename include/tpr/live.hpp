@@ -0,0 +1,139 @@
+#pragma once
+
+#include <fmt/color.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "encoding.hpp"
+#include "input.hpp"
+
+namespace tpr {
+
+// Echo for capture_input which types over the target text in place. Every
+// key press redraws exactly one cell using relative cursor movement from a
+// saved origin, so the bytes written per key are bounded no matter how
+// long the test is or where the cursor is. A cell holds one character of
+// `Encoding`, a key completing only part of one redraws nothing.
+template <class T, class Encoding = Ascii>
+class LiveEcho {
+   public:
+    using traits = encoding_traits<Encoding>;
+
+    LiveEcho(std::basic_string_view<T> target, std::size_t width,
+             std::pmr::memory_resource* resource =
+                 std::pmr::get_default_resource())
+        : target_(target),
+          width_(std::max<std::size_t>(width, 1)),
+          cells_(resource) {
+        for (std::size_t i = 0; i < target_.size(); i = traits::next(target_, i)) {
+            cells_.push_back(static_cast<uint32_t>(i));
+        }
+
+        cells_.push_back(static_cast<uint32_t>(target_.size()));
+    }
+
+    // Prints the untyped target and moves back to its first cell.
+    auto begin() -> void {
+        fmt::memory_buffer out;
+        fmt::format_to(std::back_inserter(out), fmt::emphasis::faint, "{}",
+                       target_);
+
+        const auto rows = (cells() + width_ - 1) / width_;
+
+        fmt::format_to(std::back_inserter(out), "\r");
+
+        if (rows > 1) {
+            fmt::format_to(std::back_inserter(out), "\x1b[{}A", rows - 1);
+        }
+
+        fmt::format_to(std::back_inserter(out), "\x1b" "7");
+        flush(out);
+    }
+
+    auto operator()(std::basic_string_view<T> typed, char key) -> void {
+        if (traits::pending(typed)) {
+            return;
+        }
+
+        fmt::memory_buffer out;
+
+        const auto typed_cells = traits::characters(typed);
+
+        if (key == key_backspace or key == key_erase) {
+            const auto cell = typed_cells;
+
+            if (cell < cells()) {
+                move(out, cell);
+                fmt::format_to(std::back_inserter(out), fmt::emphasis::faint,
+                               "{}", this->cell(cell));
+            }
+        } else if (typed_cells) {
+            const auto cell = typed_cells - 1;
+
+            if (cell < cells()) {
+                const auto style =
+                    typed.substr(traits::last(typed)) == this->cell(cell)
+                        ? fg(fmt::terminal_color::green)
+                        : fg(fmt::terminal_color::red);
+                move(out, cell);
+                fmt::format_to(std::back_inserter(out), style, "{}",
+                               this->cell(cell));
+            }
+        }
+
+        move(out, std::min(typed_cells, cells()));
+        flush(out);
+    }
+
+    // Puts the cursor on the line below the target.
+    auto finish() -> void {
+        fmt::memory_buffer out;
+        move(out, cells() ? cells() - 1 : 0);
+        fmt::format_to(std::back_inserter(out), "\n");
+        flush(out);
+    }
+
+   private:
+    [[nodiscard]] auto cells() const noexcept -> std::size_t {
+        return cells_.size() - 1;
+    }
+
+    // Code units of the target character in `cell`.
+    [[nodiscard]] auto cell(std::size_t cell) const noexcept
+        -> std::basic_string_view<T> {
+        return target_.substr(cells_[cell], cells_[cell + 1] - cells_[cell]);
+    }
+
+    auto move(fmt::memory_buffer& out, std::size_t cell) const -> void {
+        const auto row = cell / width_;
+        const auto column = cell % width_;
+
+        fmt::format_to(std::back_inserter(out), "\x1b" "8");
+
+        if (row) {
+            fmt::format_to(std::back_inserter(out), "\x1b[{}B", row);
+        }
+
+        if (column) {
+            fmt::format_to(std::back_inserter(out), "\x1b[{}C", column);
+        }
+    }
+
+    static auto flush(const fmt::memory_buffer& out) -> void {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+
+    std::basic_string_view<T> target_;
+    std::size_t width_;
+    std::pmr::vector<uint32_t> cells_;  // first code unit of every cell
+};
+
+}  // namespace tpr
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tpr {
+
+// Read-only view of a whole file mapped into memory. The mapping is
+// released when the object is destroyed, moving it keeps the bytes at the
+// same address so views into `bytes()` stay valid.
+class MappedFile {
+   public:
+    MappedFile() noexcept = default;
+
+    MappedFile(const MappedFile&) = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)) {}
+
+    auto operator=(MappedFile&& other) noexcept -> MappedFile& {
+        if (this != &other) {
+            release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    ~MappedFile() { release(); }
+
+    static auto open(const std::filesystem::path& path)
+        -> std::optional<MappedFile> {
+        MappedFile file;
+
+#if defined(_WIN32)
+        const HANDLE handle =
+            CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+        if (handle == INVALID_HANDLE_VALUE) {
+            return std::nullopt;
+        }
+
+        LARGE_INTEGER size;
+
+        if (not GetFileSizeEx(handle, &size)) {
+            CloseHandle(handle);
+            return std::nullopt;
+        }
+
+        if (size.QuadPart == 0) {
+            CloseHandle(handle);
+            return file;
+        }
+
+        const HANDLE mapping =
+            CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(handle);
+
+        if (not mapping) {
+            return std::nullopt;
+        }
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if (not data) {
+            return std::nullopt;
+        }
+
+        file.data_ = static_cast<const std::byte*>(data);
+        file.size_ = static_cast<std::size_t>(size.QuadPart);
+#else
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+
+        if (descriptor < 0) {
+            return std::nullopt;
+        }
+
+        struct stat status;
+
+        if (::fstat(descriptor, &status) != 0) {
+            ::close(descriptor);
+            return std::nullopt;
+        }
+
+        if (status.st_size == 0) {
+            ::close(descriptor);
+            return file;
+        }
+
+        const auto size = static_cast<std::size_t>(status.st_size);
+        void* data =
+            ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);
+
+        if (data == MAP_FAILED) {
+            return std::nullopt;
+        }
+
+        ::madvise(data, size, MADV_SEQUENTIAL);
+
+        file.data_ = static_cast<const std::byte*>(data);
+        file.size_ = size;
+#endif
+
+        return file;
+    }
+
+    [[nodiscard]] auto bytes() const noexcept -> std::span<const std::byte> {
+        return {data_, size_};
+    }
+
+    template <class T>
+    [[nodiscard]] auto view() const noexcept -> std::basic_string_view<T> {
+        static_assert(sizeof(T) == 1, "mapped text must use 1 byte chars");
+        return {reinterpret_cast<const T*>(data_), size_};
+    }
+
+    [[nodiscard]] auto size() const noexcept { return size_; }
+    [[nodiscard]] auto empty() const noexcept { return size_ == 0; }
+
+   private:
+    auto release() noexcept -> void {
+        if (not data_) {
+            return;
+        }
+
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+#else
+        ::munmap(const_cast<std::byte*>(data_), size_);
+#endif
+
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const std::byte* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+}  // namespace tpr
@@ -0,0 +1,685 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "generator.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "profile.hpp"
+#include "random.hpp"
+#include "sampling.hpp"
+
+namespace tpr {
+
+// Compiled Markov model (.tpm) layout, all integers in native byte order:
+//
+//   MarkovHeader | uint32_t offsets[words + 1] | uint32_t targets[edges] |
+//   uint32_t alias[edges] | uint32_t continuation_offsets[edges + 1] |
+//   uint32_t continuations[entries] | uint32_t continuation_alias[entries] |
+//   uint32_t start_alias[edges] | float probability[edges] |
+//   float continuation_probability[entries] | float start_probability[edges]
+//
+// Edges are the distinct word pairs of the corpus, entries its distinct
+// word triples. Words are indices into the dictionary the model was built
+// with, which `fingerprint` identifies.
+struct MarkovHeader {
+    static constexpr uint32_t signature = 0x314d5054;  // "TPM1"
+    static constexpr uint32_t current_version = 1;
+
+    uint32_t magic = signature;
+    uint32_t version = current_version;
+    uint64_t words = 0;
+    uint64_t edges = 0;
+    uint64_t entries = 0;
+    uint64_t fingerprint = 0;
+};
+
+static_assert(sizeof(MarkovHeader) == 40);
+
+// Identifies the words of a dictionary and their order, a text dictionary
+// and its .tpd have the same fingerprint.
+template <class T>
+auto dictionary_fingerprint(const Dictionary<T>& dictionary) noexcept
+    -> uint64_t {
+    uint64_t hash = dictionary.size();
+
+    for (const auto word : dictionary) {
+        hash = xxhash64(std::as_bytes(std::span(word)), hash);
+    }
+
+    return hash;
+}
+
+// Trigram model of a corpus over the words of a dictionary, backing off
+// to bigrams, in CSR form: the edges of word `w` are
+// `[offsets[w], offsets[w + 1])`, each naming its second word, and the
+// continuations of edge `e` are `[continuation_offsets[e],
+// continuation_offsets[e + 1])`, each naming the edge it moves to. Every
+// node has its own alias table over its range, positions relative to the
+// range start, so generating a word costs O(1). The tables either point
+// into a mapped .tpm file or are owned.
+class MarkovModel {
+   public:
+    using allocator_type = std::pmr::polymorphic_allocator<uint32_t>;
+    using container = std::pmr::vector<uint32_t>;
+    using probabilities = std::pmr::vector<float>;
+
+    static constexpr uint32_t no_edge = std::numeric_limits<uint32_t>::max();
+
+    struct Sizes {
+        uint64_t words = 0;
+        uint64_t edges = 0;
+        uint64_t entries = 0;
+
+        // uint32_t and float values of every table, in file order
+        [[nodiscard]] auto indices() const noexcept -> uint64_t {
+            return words + 1 + 2 * edges + edges + 1 + 2 * entries + edges;
+        }
+
+        [[nodiscard]] auto weights() const noexcept -> uint64_t {
+            return 2 * edges + entries;
+        }
+    };
+
+    // Model loaded from a .tpm file, all tables live in the mapping.
+    MarkovModel(MappedFile file, std::span<const uint32_t> indices,
+                std::span<const float> weights, const Sizes& sizes,
+                uint64_t fingerprint) noexcept
+        : file_(std::move(file)), fingerprint_(fingerprint) {
+        slice(indices, weights, sizes);
+    }
+
+    // Model built from tables in file order, they are owned.
+    MarkovModel(container indices, probabilities weights, const Sizes& sizes,
+                uint64_t fingerprint) noexcept
+        : owned_indices_(std::move(indices)),
+          owned_weights_(std::move(weights)),
+          fingerprint_(fingerprint) {
+        slice(owned_indices_, owned_weights_, sizes);
+    }
+
+    // Moving a vector keeps its buffer, so the spans stay valid.
+    MarkovModel(MarkovModel&&) noexcept = default;
+    auto operator=(MarkovModel&&) -> MarkovModel& = delete;
+
+    [[nodiscard]] auto words() const noexcept -> std::size_t {
+        return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+
+    [[nodiscard]] auto edges() const noexcept { return targets_.size(); }
+    [[nodiscard]] auto entries() const noexcept {
+        return continuations_.size();
+    }
+    [[nodiscard]] auto empty() const noexcept { return targets_.empty(); }
+
+    [[nodiscard]] auto fingerprint() const noexcept { return fingerprint_; }
+
+    [[nodiscard]] auto indices() const noexcept { return indices_; }
+    [[nodiscard]] auto weights() const noexcept { return weights_; }
+
+    // True if walking stays inside the tables: both offset tables start at
+    // zero, never decrease and end at the size of the table they index,
+    // every edge names a word, every continuation an edge and every alias
+    // a position inside its node's range.
+    [[nodiscard]] auto valid() const noexcept -> bool {
+        const auto csr = [](std::span<const uint32_t> ranges,
+                            std::size_t size) {
+            return not ranges.empty() and ranges.front() == 0 and
+                   ranges.back() == size and
+                   std::ranges::is_sorted(ranges);
+        };
+
+        const auto below = [](std::span<const uint32_t> table,
+                              std::size_t bound) {
+            return std::ranges::all_of(
+                table, [bound](uint32_t value) { return value < bound; });
+        };
+
+        const auto aliases = [](std::span<const uint32_t> ranges,
+                                std::span<const uint32_t> alias) {
+            for (std::size_t node = 0; node + 1 < ranges.size(); ++node) {
+                const auto size = ranges[node + 1] - ranges[node];
+
+                if (not std::ranges::all_of(
+                        alias.subspan(ranges[node], size),
+                        [size](uint32_t value) { return value < size; })) {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        return csr(offsets_, edges()) and
+               csr(continuation_offsets_, entries()) and
+               below(targets_, words()) and below(continuations_, edges()) and
+               below(start_alias_, edges()) and aliases(offsets_, alias_) and
+               aliases(continuation_offsets_, continuation_alias_);
+    }
+
+    // Appends `amount` word indices following the corpus. A chain starts
+    // with a pair drawn by how often it starts a sentence, every next word
+    // is drawn by how often it follows the last two words, or the last word
+    // if those were never followed. A word never followed starts a new
+    // chain.
+    template <class URBG>
+    auto walk(uint64_t amount, URBG& rng, std::pmr::vector<uint32_t>& out) const
+        -> void {
+        if (empty()) {
+            return;
+        }
+
+        const auto draw = [&rng](uint32_t begin, uint32_t end,
+                                 std::span<const float> probability,
+                                 std::span<const uint32_t> alias) {
+            const auto column =
+                std::uniform_int_distribution<uint32_t>(begin, end - 1)(rng);
+            const auto coin =
+                std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+
+            return coin < probability[column] ? column : begin + alias[column];
+        };
+
+        const auto size = out.size() + amount;
+        out.reserve(size);
+
+        uint32_t edge = no_edge;
+
+        while (out.size() < size) {
+            if (edge == no_edge) {
+                edge = draw(0, static_cast<uint32_t>(edges()),
+                            start_probability_, start_alias_);
+
+                // a restart is the only place the first word is looked up
+                const auto first = std::ranges::upper_bound(offsets_, edge);
+                out.push_back(
+                    static_cast<uint32_t>(first - offsets_.begin() - 1));
+
+                if (out.size() < size) {
+                    out.push_back(targets_[edge]);
+                }
+
+                continue;
+            }
+
+            const auto word = targets_[edge];
+
+            if (const auto begin = continuation_offsets_[edge],
+                end = continuation_offsets_[edge + 1];
+                begin < end) {
+                edge = continuations_[draw(begin, end,
+                                           continuation_probability_,
+                                           continuation_alias_)];
+            } else if (offsets_[word] < offsets_[word + 1]) {
+                edge = draw(offsets_[word], offsets_[word + 1], probability_,
+                            alias_);
+            } else {
+                edge = no_edge;
+                continue;
+            }
+
+            out.push_back(targets_[edge]);
+        }
+    }
+
+   private:
+    auto slice(std::span<const uint32_t> indices,
+               std::span<const float> weights, const Sizes& sizes) noexcept
+        -> void {
+        indices_ = indices;
+        weights_ = weights;
+
+        const auto next = [&indices](std::size_t size) {
+            const auto table = indices.first(size);
+            indices = indices.subspan(size);
+            return table;
+        };
+
+        const auto next_weights = [&weights](std::size_t size) {
+            const auto table = weights.first(size);
+            weights = weights.subspan(size);
+            return table;
+        };
+
+        offsets_ = next(sizes.words + 1);
+        targets_ = next(sizes.edges);
+        alias_ = next(sizes.edges);
+        continuation_offsets_ = next(sizes.edges + 1);
+        continuations_ = next(sizes.entries);
+        continuation_alias_ = next(sizes.entries);
+        start_alias_ = next(sizes.edges);
+        probability_ = next_weights(sizes.edges);
+        continuation_probability_ = next_weights(sizes.entries);
+        start_probability_ = next_weights(sizes.edges);
+    }
+
+    MappedFile file_;
+    container owned_indices_;
+    probabilities owned_weights_;
+    uint64_t fingerprint_ = 0;
+
+    std::span<const uint32_t> indices_;
+    std::span<const float> weights_;
+
+    std::span<const uint32_t> offsets_;
+    std::span<const uint32_t> targets_;
+    std::span<const uint32_t> alias_;
+    std::span<const uint32_t> continuation_offsets_;
+    std::span<const uint32_t> continuations_;
+    std::span<const uint32_t> continuation_alias_;
+    std::span<const uint32_t> start_alias_;
+    std::span<const float> probability_;
+    std::span<const float> continuation_probability_;
+    std::span<const float> start_probability_;
+};
+
+namespace detail {
+
+// Dictionary index of every word of `corpus` in order, `MarkovModel::no_edge`
+// where a chain breaks: after a sentence and around words the dictionary
+// does not have. Words are runs of non blank characters, matched in
+// lower case without the punctuation around them.
+template <class T>
+auto corpus_words(const Dictionary<T>& dictionary,
+                  std::basic_string_view<T> corpus,
+                  std::pmr::memory_resource* resource)
+    -> std::pmr::vector<uint32_t> {
+    constexpr auto boundary = MarkovModel::no_edge;
+
+    const auto blank = [](T c) {
+        return c == T(' ') or c == T('\n') or c == T('\r') or c == T('\t');
+    };
+
+    const auto punctuation = [](T c) {
+        return (c >= T('!') and c <= T('/')) or (c >= T(':') and c <= T('@')) or
+               (c >= T('[') and c <= T('`')) or (c >= T('{') and c <= T('~'));
+    };
+
+    // the first, most frequent one of repeated words
+    std::pmr::unordered_map<std::basic_string_view<T>, uint32_t> ids(resource);
+    ids.reserve(dictionary.size());
+
+    for (std::size_t i = 0; i < dictionary.size(); ++i) {
+        ids.try_emplace(dictionary[i], static_cast<uint32_t>(i));
+    }
+
+    std::pmr::vector<uint32_t> sequence(resource);
+    std::basic_string<T> word;
+
+    for (std::size_t i = 0; i < corpus.size();) {
+        if (blank(corpus[i])) {
+            ++i;
+            continue;
+        }
+
+        const auto start = i;
+
+        while (i < corpus.size() and not blank(corpus[i])) {
+            ++i;
+        }
+
+        auto token = corpus.substr(start, i - start);
+        const auto last = token.back();
+
+        while (not token.empty() and punctuation(token.front())) {
+            token.remove_prefix(1);
+        }
+
+        while (not token.empty() and punctuation(token.back())) {
+            token.remove_suffix(1);
+        }
+
+        word.assign(token);
+
+        for (auto& c : word) {
+            if (c >= T('A') and c <= T('Z')) {
+                c = static_cast<T>(c - T('A') + T('a'));
+            }
+        }
+
+        const auto found = ids.find(word);
+        sequence.push_back(found == ids.end() ? boundary : found->second);
+
+        if (last == T('.') or last == T('!') or last == T('?')) {
+            sequence.push_back(boundary);
+        }
+    }
+
+    return sequence;
+}
+
+// Sorted distinct values of `keys` and how often each occurs.
+inline auto count_distinct(std::pmr::vector<uint64_t>& keys,
+                           std::pmr::vector<double>& counts) -> void {
+    std::ranges::sort(keys);
+    counts.clear();
+
+    std::size_t size = 0;
+
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (i and keys[i] == keys[size - 1]) {
+            counts.back() += 1.0;
+            continue;
+        }
+
+        keys[size++] = keys[i];
+        counts.push_back(1.0);
+    }
+
+    keys.resize(size);
+}
+
+}  // namespace detail
+
+// Model of `corpus` over the words of `dictionary`, built by sorting and
+// counting its word pairs and triples. Empty if no two words of the
+// dictionary follow each other in the corpus.
+template <class T>
+auto build_markov_model(const Dictionary<T>& dictionary,
+                        std::basic_string_view<T> corpus,
+                        const MarkovModel::allocator_type& allocator = {})
+    -> MarkovModel {
+    TPR_PROFILE_SCOPE(index_build);
+
+    constexpr auto boundary = MarkovModel::no_edge;
+
+    // only the tables come from `allocator`, which may well be an arena
+    auto* resource = std::pmr::get_default_resource();
+
+    const auto sequence = detail::corpus_words(dictionary, corpus, resource);
+
+    const auto pair = [](uint32_t a, uint32_t b) {
+        return uint64_t{a} << 32 | b;
+    };
+
+    std::pmr::vector<uint64_t> edges(resource);
+    std::pmr::vector<double> edge_counts(resource);
+
+    for (std::size_t i = 1; i < sequence.size(); ++i) {
+        if (sequence[i - 1] != boundary and sequence[i] != boundary) {
+            edges.push_back(pair(sequence[i - 1], sequence[i]));
+        }
+    }
+
+    detail::count_distinct(edges, edge_counts);
+
+    // edge starting at every position, chains start where the one before
+    // has none
+    std::pmr::vector<uint32_t> position_edges(sequence.size(), boundary,
+                                              resource);
+    std::pmr::vector<double> start_counts(edges.size(), 0.0, resource);
+
+    for (std::size_t i = 0; i + 1 < sequence.size(); ++i) {
+        if (sequence[i] == boundary or sequence[i + 1] == boundary) {
+            continue;
+        }
+
+        const auto found = std::ranges::lower_bound(
+            edges, pair(sequence[i], sequence[i + 1]));
+        position_edges[i] = static_cast<uint32_t>(found - edges.begin());
+
+        if (i == 0 or position_edges[i - 1] == boundary) {
+            start_counts[position_edges[i]] += 1.0;
+        }
+    }
+
+    std::pmr::vector<uint64_t> entries(resource);
+    std::pmr::vector<double> entry_counts(resource);
+
+    for (std::size_t i = 0; i + 1 < sequence.size(); ++i) {
+        if (position_edges[i] != boundary and
+            position_edges[i + 1] != boundary) {
+            entries.push_back(pair(position_edges[i], position_edges[i + 1]));
+        }
+    }
+
+    detail::count_distinct(entries, entry_counts);
+
+    const MarkovModel::Sizes sizes{
+        .words = dictionary.size(),
+        .edges = edges.size(),
+        .entries = entries.size(),
+    };
+
+    MarkovModel::container indices(sizes.indices(), 0, allocator);
+    MarkovModel::probabilities weights(sizes.weights(), 0.0f, allocator);
+
+    auto rest = std::span(indices);
+    auto rest_weights = std::span(weights);
+
+    const auto next = [&rest](std::size_t size) {
+        const auto table = rest.first(size);
+        rest = rest.subspan(size);
+        return table;
+    };
+
+    const auto next_weights = [&rest_weights](std::size_t size) {
+        const auto table = rest_weights.first(size);
+        rest_weights = rest_weights.subspan(size);
+        return table;
+    };
+
+    const auto offsets = next(sizes.words + 1);
+    const auto targets = next(sizes.edges);
+    const auto alias = next(sizes.edges);
+    const auto continuation_offsets = next(sizes.edges + 1);
+    const auto continuations = next(sizes.entries);
+    const auto continuation_alias = next(sizes.entries);
+    const auto start_alias = next(sizes.edges);
+    const auto probability = next_weights(sizes.edges);
+    const auto continuation_probability = next_weights(sizes.entries);
+    const auto start_probability = next_weights(sizes.edges);
+
+    // keys are sorted, so both CSR tables fill front to back
+    for (std::size_t e = 0; e < edges.size(); ++e) {
+        ++offsets[(edges[e] >> 32) + 1];
+        targets[e] = static_cast<uint32_t>(edges[e]);
+    }
+
+    for (std::size_t k = 0; k < entries.size(); ++k) {
+        ++continuation_offsets[(entries[k] >> 32) + 1];
+        continuations[k] = static_cast<uint32_t>(entries[k]);
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::partial_sum(continuation_offsets.begin(), continuation_offsets.end(),
+                     continuation_offsets.begin());
+
+    detail::AliasScratch scratch(resource);
+
+    const auto build_nodes = [&scratch](std::span<const uint32_t> ranges,
+                                        std::span<const double> counts,
+                                        std::span<float> node_probability,
+                                        std::span<uint32_t> node_alias) {
+        for (std::size_t node = 0; node + 1 < ranges.size(); ++node) {
+            const auto begin = ranges[node];
+            const auto size = ranges[node + 1] - begin;
+
+            detail::build_alias_table<float>(
+                counts.subspan(begin, size),
+                node_probability.subspan(begin, size),
+                node_alias.subspan(begin, size), scratch);
+        }
+    };
+
+    build_nodes(offsets, edge_counts, probability, alias);
+    build_nodes(continuation_offsets, entry_counts, continuation_probability,
+                continuation_alias);
+    detail::build_alias_table<float>(start_counts, start_probability,
+                                     start_alias, scratch);
+
+    return MarkovModel(std::move(indices), std::move(weights), sizes,
+                       dictionary_fingerprint(dictionary));
+}
+
+inline auto is_compiled_markov_model(const MappedFile& file) noexcept -> bool {
+    uint32_t magic = 0;
+
+    if (file.size() < sizeof(MarkovHeader)) {
+        return false;
+    }
+
+    std::memcpy(&magic, file.bytes().data(), sizeof(magic));
+    return magic == MarkovHeader::signature;
+}
+
+// Reads a compiled .tpm model of `dictionary`, or builds one from the
+// corpus text at `path`. Nullopt if the file can not be read or a compiled
+// model belongs to another dictionary or is corrupt.
+template <class T>
+auto read_markov_model(const std::filesystem::path& path,
+                       const Dictionary<T>& dictionary,
+                       const MarkovModel::allocator_type& allocator = {})
+    -> std::optional<MarkovModel> {
+    auto file = MappedFile::open(path);
+
+    if (not file) {
+        return std::nullopt;
+    }
+
+    if (not is_compiled_markov_model(*file)) {
+        return build_markov_model(dictionary, file->template view<T>(),
+                                  allocator);
+    }
+
+    const auto bytes = file->bytes();
+
+    MarkovHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    const MarkovModel::Sizes sizes{
+        .words = header.words,
+        .edges = header.edges,
+        .entries = header.entries,
+    };
+
+    // bounded by the file size before the table sizes are multiplied
+    if (header.version != MarkovHeader::current_version or
+        header.words != dictionary.size() or header.edges > bytes.size() or
+        header.entries > bytes.size() or
+        sizeof(header) + sizes.indices() * sizeof(uint32_t) +
+                sizes.weights() * sizeof(float) !=
+            bytes.size() or
+        header.fingerprint != dictionary_fingerprint(dictionary)) {
+        return std::nullopt;
+    }
+
+    const auto* indices =
+        reinterpret_cast<const uint32_t*>(bytes.data() + sizeof(header));
+    const auto* weights = reinterpret_cast<const float*>(
+        bytes.data() + sizeof(header) + sizes.indices() * sizeof(uint32_t));
+
+    auto model = std::make_optional<MarkovModel>(
+        std::move(*file), std::span{indices, sizes.indices()},
+        std::span{weights, sizes.weights()}, sizes, header.fingerprint);
+
+    if (not model->valid()) {
+        return std::nullopt;
+    }
+
+    return model;
+}
+
+// Writes `model` in the .tpm layout, returns false on I/O failure.
+inline auto compile_markov_model(const MarkovModel& model,
+                                 const std::filesystem::path& path) -> bool {
+    const MarkovHeader header{
+        .words = model.words(),
+        .edges = model.edges(),
+        .entries = model.entries(),
+        .fingerprint = model.fingerprint(),
+    };
+
+    std::ofstream stream(path, std::ios::out | std::ios::binary);
+
+    if (not stream) {
+        return false;
+    }
+
+    const auto write = [&stream](std::span<const std::byte> bytes) {
+        stream.write(reinterpret_cast<const char*>(bytes.data()),
+                     static_cast<std::streamsize>(bytes.size()));
+    };
+
+    write(std::as_bytes(std::span(&header, 1)));
+    write(std::as_bytes(model.indices()));
+    write(std::as_bytes(model.weights()));
+
+    return static_cast<bool>(stream.flush());
+}
+
+// Tests following a Markov model of a corpus instead of independent draws,
+// generated through the same interface as TestGenerator. `amount` is the
+// number of words, `top`, the length limits and the distribution do not
+// apply: the words are those of the corpus.
+template <class T, class Engine = Xoshiro256>
+class MarkovGenerator {
+   public:
+    using engine_type = Engine;
+    using char_type = T;
+    using string = std::pmr::basic_string<T>;
+    using allocator_type = std::pmr::polymorphic_allocator<T>;
+
+    MarkovGenerator(Dictionary<T> dictionary, MarkovModel model,
+                    uint64_t seed, const allocator_type& allocator = {})
+        : dictionary_(std::move(dictionary)),
+          model_(std::move(model)),
+          engine_(make_engine<Engine>(seed)),
+          allocator_(allocator) {}
+
+    auto seed(uint64_t seed, uint64_t stream = 0) -> void {
+        engine_ = make_engine<Engine>(seed, stream);
+    }
+
+    auto generate(const TestConfig& config) -> string {
+        return generate(config, engine_, allocator_);
+    }
+
+    // Thread safe as long as every caller brings its own engine.
+    auto generate(const TestConfig& config, Engine& engine,
+                  const allocator_type& allocator) const -> string {
+        std::pmr::vector<uint32_t> words(allocator);
+
+        {
+            TPR_PROFILE_SCOPE(sampling);
+            model_.walk(config.amount, engine, words);
+        }
+
+        return assemble_test(dictionary_, words, allocator);
+    }
+
+    [[nodiscard]] auto dictionary() const noexcept -> const Dictionary<T>& {
+        return dictionary_;
+    }
+
+    [[nodiscard]] auto model() const noexcept -> const MarkovModel& {
+        return model_;
+    }
+
+    [[nodiscard]] auto engine() noexcept -> Engine& { return engine_; }
+
+   private:
+    Dictionary<T> dictionary_;
+    MarkovModel model_;
+    Engine engine_;
+    allocator_type allocator_;
+};
+
+}  // namespace tpr
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace tpr {
+
+// Index of the first byte where `lhs` and `rhs` differ, `size` if they
+// are equal. Compares 32 (AVX2) or 16 (SSE2, NEON) bytes per step, the
+// instruction set is chosen at compile time with a scalar fallback.
+inline auto mismatch(const void* lhs, const void* rhs,
+                     std::size_t size) noexcept -> std::size_t {
+    const auto* a = static_cast<const unsigned char*>(lhs);
+    const auto* b = static_cast<const unsigned char*>(rhs);
+
+    std::size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 32 <= size; i += 32) {
+        const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        const auto equal =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+
+        if (equal != UINT32_MAX) {
+            return i + std::countr_one(equal);
+        }
+    }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + 16 <= size; i += 16) {
+        const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const auto y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const auto equal =
+            static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+
+        if (equal != 0xffff) {
+            return i + std::countr_one(equal);
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= size; i += 16) {
+        const auto equal = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+        // narrow every byte to a nibble, giving a 64 bit mask
+        const uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)),
+            0);
+
+        if (mask != UINT64_MAX) {
+            return i + std::countr_one(mask) / 4;
+        }
+    }
+#endif
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t x;
+        uint64_t y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+
+        if (x != y) {
+            const auto bits = std::endian::native == std::endian::little
+                                  ? std::countr_zero(x ^ y)
+                                  : std::countl_zero(x ^ y);
+            return i + static_cast<std::size_t>(bits) / 8;
+        }
+    }
+
+    for (; i < size; ++i) {
+        if (a[i] != b[i]) {
+            return i;
+        }
+    }
+
+    return size;
+}
+
+}  // namespace tpr
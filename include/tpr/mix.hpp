@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "generator.hpp"
+#include "length_index.hpp"
+#include "random.hpp"
+#include "sampling.hpp"
+
+namespace tpr {
+
+// A --dictionary of a mixed test, given as "path[:weight]".
+struct MixSource {
+    std::string path;
+    double weight = 1.0;
+};
+
+// The weight follows the last ':' if the rest is a number, so paths with
+// a drive letter parse without one. Nullopt for an empty path or a weight
+// that is not positive.
+inline auto parse_mix_source(std::string_view text)
+    -> std::optional<MixSource> {
+    auto path = text;
+    double weight = 1.0;
+
+    if (const auto colon = text.rfind(':'); colon != std::string_view::npos) {
+        const auto digits = text.substr(colon + 1);
+        double parsed = 0.0;
+
+        const auto [end, error] = std::from_chars(
+            digits.data(), digits.data() + digits.size(), parsed);
+
+        if (not digits.empty() and error == std::errc{} and
+            end == digits.data() + digits.size()) {
+            path = text.substr(0, colon);
+            weight = parsed;
+        }
+    }
+
+    if (path.empty() or not(weight > 0.0) or not std::isfinite(weight)) {
+        return std::nullopt;
+    }
+
+    return MixSource{std::string(path), weight};
+}
+
+// One loaded source of a mixed test.
+template <class T>
+struct MixedDictionary {
+    Dictionary<T> dictionary;
+    LengthIndex index;
+    double weight = 1.0;
+};
+
+// Tests drawing every word from one of several dictionaries, picked with
+// probability proportional to its weight. Sources keep their own length
+// index, so a test costs one index query per source and O(amount) draws,
+// it is never filtered out of a merged word list.
+template <class T, class Engine = Xoshiro256>
+class MixedGenerator {
+   public:
+    using engine_type = Engine;
+    using char_type = T;
+    using string = std::pmr::basic_string<T>;
+    using allocator_type = std::pmr::polymorphic_allocator<T>;
+
+    MixedGenerator(std::pmr::vector<MixedDictionary<T>> sources,
+                   uint64_t seed, const allocator_type& allocator = {})
+        : sources_(std::move(sources)),
+          engine_(make_engine<Engine>(seed)),
+          allocator_(allocator) {}
+
+    auto seed(uint64_t seed, uint64_t stream = 0) -> void {
+        engine_ = make_engine<Engine>(seed, stream);
+    }
+
+    auto generate(const TestConfig& config) -> string {
+        return generate(config, engine_, allocator_);
+    }
+
+    // Words of a source are sampled like those of a single dictionary and
+    // joined in the order their sources were drawn, `top` and the length
+    // limits apply to every source. Sources without a matching word are
+    // left out, a source drawn more often than it has distinct words runs
+    // out like a single dictionary does. Thread safe as long as every
+    // caller brings its own engine.
+    auto generate(const TestConfig& config, Engine& engine,
+                  const allocator_type& allocator) const -> string {
+        const auto count = sources_.size();
+
+        std::pmr::vector<Candidates> candidates(allocator);
+        std::pmr::vector<double> weights(allocator);
+        candidates.reserve(count);
+        weights.reserve(count);
+
+        for (const auto& source : sources_) {
+            candidates.push_back(source.index.query(
+                config.min_length, config.max_length, config.top));
+            weights.push_back(candidates.back().empty() ? 0.0 : source.weight);
+        }
+
+        string test(allocator);
+
+        if (std::ranges::all_of(weights, [](double w) { return w == 0.0; })) {
+            return test;
+        }
+
+        // source of every word first, then each source's words at once
+        const AliasTable pick(weights, allocator);
+
+        std::pmr::vector<uint32_t> order(allocator);
+        std::pmr::vector<uint64_t> draws(count, 0, allocator);
+        order.reserve(config.amount);
+
+        for (uint64_t i = 0; i < config.amount; ++i) {
+            const auto source = static_cast<uint32_t>(pick(engine));
+            order.push_back(source);
+            ++draws[source];
+        }
+
+        std::pmr::vector<std::pmr::vector<uint32_t>> words(count, allocator);
+
+        for (std::size_t source = 0; source < count; ++source) {
+            if (draws[source]) {
+                auto part = config;
+                part.amount = draws[source];
+                sample_words(candidates[source], part, engine, words[source]);
+            }
+        }
+
+        std::pmr::vector<std::size_t> next(count, 0, allocator);
+
+        const auto join = [&](auto&& visit) {
+            std::ranges::fill(next, 0);
+
+            for (const auto source : order) {
+                if (next[source] < words[source].size()) {
+                    visit(sources_[source].dictionary,
+                          words[source][next[source]++]);
+                }
+            }
+        };
+
+        std::size_t size = 0;
+
+        join([&size](const Dictionary<T>& dictionary, uint32_t word) {
+            size += dictionary.length(word) + 1;
+        });
+
+        test.reserve(size);
+
+        join([&test](const Dictionary<T>& dictionary, uint32_t word) {
+            if (not test.empty()) {
+                test.push_back(T(' '));
+            }
+
+            test.append(dictionary[word]);
+        });
+
+        return test;
+    }
+
+    [[nodiscard]] auto sources() const noexcept
+        -> std::span<const MixedDictionary<T>> {
+        return sources_;
+    }
+
+    [[nodiscard]] auto engine() noexcept -> Engine& { return engine_; }
+
+   private:
+    std::pmr::vector<MixedDictionary<T>> sources_;
+    Engine engine_;
+    allocator_type allocator_;
+};
+
+}  // namespace tpr
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace tpr {
+
+// Phases timed by TPR_PROFILE_SCOPE, in the order they run.
+enum class Phase : uint8_t {
+    dictionary_open,
+    dictionary_parse,
+    index_build,
+    sampling,
+    assembly,
+    input,
+    scoring,
+};
+
+inline constexpr std::size_t phase_count = 7;
+
+inline constexpr std::array<std::string_view, phase_count> phase_names{
+    "dictionary open", "dictionary parse", "index build", "sampling",
+    "assembly",        "input",            "scoring",
+};
+
+namespace detail {
+
+// Phase timed on this thread, `phase_count` outside of every phase.
+inline thread_local std::size_t current_phase = phase_count;
+
+// Taken while static objects are initialized, before main runs. Loading
+// the executable and its libraries comes before and is not included.
+inline const std::chrono::steady_clock::time_point process_start =
+    std::chrono::steady_clock::now();
+
+}  // namespace detail
+
+// Time spent and heap allocations made per phase by every thread of the
+// process. Nothing is recorded until it is enabled, so instrumented builds
+// only pay a relaxed load per timer and allocation when --profile is not
+// given.
+class Profile {
+   public:
+    auto enable() noexcept -> void {
+        enabled_.store(true, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto enabled() const noexcept -> bool {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    auto add(Phase phase, std::chrono::nanoseconds elapsed) noexcept -> void {
+        const auto i = static_cast<std::size_t>(phase);
+
+        nanoseconds_[i].fetch_add(static_cast<uint64_t>(elapsed.count()),
+                                  std::memory_order_relaxed);
+        calls_[i].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto nanoseconds(Phase phase) const noexcept -> uint64_t {
+        return nanoseconds_[static_cast<std::size_t>(phase)].load(
+            std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto calls(Phase phase) const noexcept -> uint64_t {
+        return calls_[static_cast<std::size_t>(phase)].load(
+            std::memory_order_relaxed);
+    }
+
+    // Counts a heap allocation toward the phase timed on the calling
+    // thread, called by the operator new of profiled builds.
+    auto allocated(std::size_t bytes) noexcept -> void {
+        if (not enabled()) {
+            return;
+        }
+
+        allocations_[detail::current_phase].fetch_add(
+            1, std::memory_order_relaxed);
+        allocated_bytes_[detail::current_phase].fetch_add(
+            bytes, std::memory_order_relaxed);
+    }
+
+    // Of `phase`, or made outside of every phase for nullopt.
+    [[nodiscard]] auto allocations(std::optional<Phase> phase) const noexcept
+        -> uint64_t {
+        return allocations_[slot(phase)].load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto allocated_bytes(
+        std::optional<Phase> phase) const noexcept -> uint64_t {
+        return allocated_bytes_[slot(phase)].load(std::memory_order_relaxed);
+    }
+
+    // Records the time from process start to the first test shown, later
+    // calls keep the first one.
+    auto prompted() noexcept -> void {
+        if (not enabled()) {
+            return;
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() -
+                             detail::process_start;
+        uint64_t none = 0;
+
+        prompt_.compare_exchange_strong(
+            none,
+            static_cast<uint64_t>(
+                std::chrono::nanoseconds(elapsed).count()),
+            std::memory_order_relaxed);
+    }
+
+    // Nanoseconds from process start to the first prompt, 0 if none was
+    // shown.
+    [[nodiscard]] auto time_to_prompt() const noexcept -> uint64_t {
+        return prompt_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    static constexpr auto slot(std::optional<Phase> phase) noexcept
+        -> std::size_t {
+        return phase ? static_cast<std::size_t>(*phase) : phase_count;
+    }
+
+    std::atomic<bool> enabled_ = false;
+    std::atomic<uint64_t> prompt_ = 0;
+    std::array<std::atomic<uint64_t>, phase_count> nanoseconds_{};
+    std::array<std::atomic<uint64_t>, phase_count> calls_{};
+    std::array<std::atomic<uint64_t>, phase_count + 1> allocations_{};
+    std::array<std::atomic<uint64_t>, phase_count + 1> allocated_bytes_{};
+};
+
+inline auto profile() noexcept -> Profile& {
+    static Profile instance;
+    return instance;
+}
+
+// Adds the lifetime of the timer to `phase` if profiling is enabled, and
+// the allocations of its thread meanwhile. Timers nest, the innermost
+// phase gets the allocations.
+class ScopedTimer {
+   public:
+    using clock = std::chrono::steady_clock;
+
+    explicit ScopedTimer(Phase phase) noexcept
+        : phase_(phase), enabled_(profile().enabled()) {
+        if (enabled_) {
+            previous_ = std::exchange(detail::current_phase,
+                                      static_cast<std::size_t>(phase));
+            start_ = clock::now();
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    auto operator=(const ScopedTimer&) -> ScopedTimer& = delete;
+
+    ~ScopedTimer() {
+        if (enabled_) {
+            profile().add(phase_, clock::now() - start_);
+            detail::current_phase = previous_;
+        }
+    }
+
+   private:
+    Phase phase_;
+    bool enabled_;
+    std::size_t previous_ = phase_count;
+    clock::time_point start_;
+};
+
+// Per phase breakdown: calls, total and mean nanoseconds, the share of
+// the instrumented time and the heap allocations and bytes. Phases overlap
+// when they run on several threads, so shares are of the summed time, not
+// of the wall clock. Allocations served by a thread's arena do not reach
+// the heap and are not counted. Ends with the time to the first prompt.
+inline auto render_profile(const Profile& profile, fmt::memory_buffer& out)
+    -> void {
+    const auto to = std::back_inserter(out);
+
+    uint64_t total = 0;
+    uint64_t allocations = profile.allocations(std::nullopt);
+    uint64_t bytes = profile.allocated_bytes(std::nullopt);
+
+    for (std::size_t i = 0; i < phase_count; ++i) {
+        const auto phase = static_cast<Phase>(i);
+
+        total += profile.nanoseconds(phase);
+        allocations += profile.allocations(phase);
+        bytes += profile.allocated_bytes(phase);
+    }
+
+    fmt::format_to(to, "\n{:<17}{:>9}{:>14}{:>11}{:>8}{:>9}{:>12}\n", "phase",
+                   "calls", "total ns", "mean ns", "share", "allocs",
+                   "heap bytes");
+
+    for (std::size_t i = 0; i < phase_count; ++i) {
+        const auto phase = static_cast<Phase>(i);
+        const auto calls = profile.calls(phase);
+        const auto nanoseconds = profile.nanoseconds(phase);
+
+        if (not calls) {
+            continue;
+        }
+
+        fmt::format_to(to, "{:<17}{:>9}{:>14}{:>11}{:>7.1f}%{:>9}{:>12}\n",
+                       phase_names[i], calls, nanoseconds, nanoseconds / calls,
+                       total ? 100.0 * nanoseconds / total : 0.0,
+                       profile.allocations(phase),
+                       profile.allocated_bytes(phase));
+    }
+
+    fmt::format_to(to, "{:<17}{:>42}{:>9}{:>12}\n", "other", "",
+                   profile.allocations(std::nullopt),
+                   profile.allocated_bytes(std::nullopt));
+    fmt::format_to(to, "{:<17}{:>9}{:>14}{:>19}{:>9}{:>12}\n", "total", "",
+                   total, "", allocations, bytes);
+
+    if (const auto prompt = profile.time_to_prompt()) {
+        fmt::format_to(to, "\ntime to prompt: {} ns since process start\n",
+                       prompt);
+    }
+}
+
+}  // namespace tpr
+
+#define TPR_PROFILE_CONCAT_(a, b) a##b
+#define TPR_PROFILE_CONCAT(a, b) TPR_PROFILE_CONCAT_(a, b)
+
+// Times the rest of the enclosing scope as `phase`, e.g.
+// TPR_PROFILE_SCOPE(sampling). Expands to nothing unless the build defines
+// TYPER_PROFILE.
+#if defined(TYPER_PROFILE)
+#define TPR_PROFILE_SCOPE(phase)                 \
+    const ::tpr::ScopedTimer TPR_PROFILE_CONCAT( \
+        tpr_profile_timer_, __LINE__)(::tpr::Phase::phase)
+#else
+#define TPR_PROFILE_SCOPE(phase) static_cast<void>(0)
+#endif
+
+// Marks the first test as shown, right after it was printed.
+#if defined(TYPER_PROFILE)
+#define TPR_PROFILE_PROMPT() ::tpr::profile().prompted()
+#else
+#define TPR_PROFILE_PROMPT() static_cast<void>(0)
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string_view>
+#include <type_traits>
+
+namespace tpr {
+
+// Small state engines, all model UniformRandomBitGenerator and take a
+// `(seed, stream)` pair so independent workers can share a master seed.
+
+class SplitMix64 {
+   public:
+    using result_type = uint64_t;
+
+    explicit constexpr SplitMix64(uint64_t seed = 0) noexcept : state_(seed) {}
+
+    static constexpr auto min() noexcept -> result_type { return 0; }
+    static constexpr auto max() noexcept -> result_type {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    constexpr auto operator()() noexcept -> result_type {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+   private:
+    uint64_t state_;
+};
+
+// xoshiro256** by Blackman and Vigna, 32 bytes of state.
+class Xoshiro256 {
+   public:
+    using result_type = uint64_t;
+
+    explicit constexpr Xoshiro256(uint64_t seed = 0,
+                                  uint64_t stream = 0) noexcept {
+        this->seed(seed, stream);
+    }
+
+    constexpr auto seed(uint64_t seed, uint64_t stream = 0) noexcept -> void {
+        SplitMix64 mix(seed ^ SplitMix64(stream)());
+
+        for (auto& word : state_) {
+            word = mix();
+        }
+    }
+
+    static constexpr auto min() noexcept -> result_type { return 0; }
+    static constexpr auto max() noexcept -> result_type {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    constexpr auto operator()() noexcept -> result_type {
+        const uint64_t result = std::rotl(state_[1] * 5, 7) * 9;
+        const uint64_t t = state_[1] << 17;
+
+        state_[2] ^= state_[0];
+        state_[3] ^= state_[1];
+        state_[1] ^= state_[2];
+        state_[0] ^= state_[3];
+        state_[2] ^= t;
+        state_[3] = std::rotl(state_[3], 45);
+
+        return result;
+    }
+
+   private:
+    std::array<uint64_t, 4> state_{};
+};
+
+// PCG32 (XSH RR) by O'Neill, 16 bytes of state with native streams.
+class Pcg32 {
+   public:
+    using result_type = uint32_t;
+
+    explicit constexpr Pcg32(uint64_t seed = 0, uint64_t stream = 0) noexcept {
+        this->seed(seed, stream);
+    }
+
+    constexpr auto seed(uint64_t seed, uint64_t stream = 0) noexcept -> void {
+        increment_ = (stream << 1) | 1;
+        state_ = 0;
+        (*this)();
+        state_ += seed;
+        (*this)();
+    }
+
+    static constexpr auto min() noexcept -> result_type { return 0; }
+    static constexpr auto max() noexcept -> result_type {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    constexpr auto operator()() noexcept -> result_type {
+        const uint64_t old = state_;
+        state_ = old * 6364136223846793005ull + increment_;
+
+        const auto shifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+        const auto rotation = static_cast<int>(old >> 59);
+
+        return std::rotr(shifted, rotation);
+    }
+
+   private:
+    uint64_t state_ = 0;
+    uint64_t increment_ = 1;
+};
+
+// Seeds any engine from a `(seed, stream)` pair, standard engines go
+// through std::seed_seq.
+template <class Engine>
+auto make_engine(uint64_t seed, uint64_t stream = 0) -> Engine {
+    if constexpr (std::is_constructible_v<Engine, uint64_t, uint64_t>) {
+        return Engine(seed, stream);
+    } else {
+        std::seed_seq sequence{
+            static_cast<uint32_t>(seed),
+            static_cast<uint32_t>(seed >> 32),
+            static_cast<uint32_t>(stream),
+            static_cast<uint32_t>(stream >> 32),
+        };
+        return Engine(sequence);
+    }
+}
+
+inline constexpr std::array engine_names{"xoshiro", "pcg", "mt19937"};
+
+// Calls `function(std::type_identity<Engine>{})` for the engine named
+// `name`, one of `engine_names`, falls back to xoshiro.
+template <class Function>
+auto with_engine(std::string_view name, Function&& function) -> decltype(auto) {
+    if (name == "pcg") {
+        return function(std::type_identity<Pcg32>{});
+    }
+
+    if (name == "mt19937") {
+        return function(std::type_identity<std::mt19937>{});
+    }
+
+    return function(std::type_identity<Xoshiro256>{});
+}
+
+}  // namespace tpr
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <fmt/color.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "alignment.hpp"
+
+namespace tpr {
+
+// Appends `typed` to `out` with every wrongly typed character, either
+// substituted or extra, in red. Characters are classified by the text
+// alignment, so a single missed character does not turn the rest of the
+// line red, and consecutive wrong characters share one escape sequence.
+// Characters are those of `Encoding`. Returns the edits found by the
+// alignment.
+template <class T, class Encoding = Ascii>
+auto render_errors(std::basic_string_view<T> target,
+                   std::basic_string_view<T> typed,
+                   fmt::basic_memory_buffer<T>& out,
+                   std::pmr::memory_resource* resource =
+                       std::pmr::get_default_resource()) -> EditCounts {
+    std::pmr::vector<uint32_t> wrong(resource);
+    const auto edits =
+        align_characters<Encoding>(target, typed, resource, &wrong);
+
+    const auto plain = [&out](std::basic_string_view<T> run) {
+        out.append(run.data(), run.data() + run.size());
+    };
+
+    std::size_t begin = 0;
+
+    for (std::size_t i = 0; i < wrong.size();) {
+        auto j = i + 1;
+
+        while (j < wrong.size() and wrong[j] == wrong[j - 1] + 1) {
+            ++j;
+        }
+
+        plain(typed.substr(begin, wrong[i] - begin));
+        fmt::format_to(std::back_inserter(out), fg(fmt::terminal_color::red),
+                       "{}", typed.substr(wrong[i], j - i));
+
+        begin = wrong[j - 1] + 1;
+        i = j;
+    }
+
+    plain(typed.substr(begin));
+
+    return edits;
+}
+
+// Writes the whole buffer with a single call.
+template <class T>
+auto flush(const fmt::basic_memory_buffer<T>& out, std::FILE* file) -> bool {
+    return std::fwrite(out.data(), sizeof(T), out.size(), file) ==
+               out.size() and
+           std::fflush(file) == 0;
+}
+
+}  // namespace tpr
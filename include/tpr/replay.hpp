@@ -0,0 +1,623 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "alignment.hpp"
+#include "arena.hpp"
+#include "bigram_index.hpp"
+#include "hash.hpp"
+#include "index_cache.hpp"
+#include "input.hpp"
+#include "latency.hpp"
+#include "mapped_file.hpp"
+#include "session_log.hpp"
+
+namespace tpr {
+
+// Session record as it lies in a mapped log, nothing is copied.
+struct LoggedSession {
+    SessionHeader header;
+    std::string_view text;
+    std::string_view typed;
+    const std::byte* keys = nullptr;  // `header.keystrokes` unaligned keys
+
+    // `i`-th keystroke, copied out as keys are not aligned in the log.
+    [[nodiscard]] auto operator[](std::size_t i) const noexcept
+        -> LoggedKey {
+        LoggedKey key;
+        std::memcpy(&key, keys + i * sizeof(LoggedKey), sizeof(key));
+        return key;
+    }
+
+    // Typing time from the first to the last keystroke.
+    [[nodiscard]] auto duration() const noexcept -> std::chrono::nanoseconds {
+        if (not header.keystrokes) {
+            return {};
+        }
+
+        return std::chrono::nanoseconds((*this)[header.keystrokes - 1].time -
+                                        (*this)[0].time);
+    }
+};
+
+// Walks the records of a session log front to back, skipping records of
+// unknown kinds. A record cut short, e.g. by a crash while writing, ends
+// the log.
+class LogReader {
+   public:
+    // Reads the records from byte `from` on, an offset a previous reader
+    // of the same log stopped at. Offsets inside the header or past the
+    // end start at the first record.
+    explicit LogReader(std::span<const std::byte> bytes,
+                       std::size_t from = 0) noexcept
+        : bytes_(bytes) {
+        LogHeader header;
+
+        if (bytes_.size() < sizeof(header)) {
+            return;
+        }
+
+        std::memcpy(&header, bytes_.data(), sizeof(header));
+
+        if (header.magic == LogHeader::signature and header.version == 1) {
+            valid_ = true;
+            offset_ = from >= sizeof(header) and from <= bytes_.size()
+                          ? from
+                          : sizeof(header);
+        }
+    }
+
+    // False if the bytes do not start with a known log header.
+    [[nodiscard]] auto valid() const noexcept { return valid_; }
+
+    // True if reading stopped at a malformed or incomplete record.
+    [[nodiscard]] auto truncated() const noexcept { return truncated_; }
+
+    // End of the last complete record read, where a reader of the log
+    // once more records were appended resumes.
+    [[nodiscard]] auto offset() const noexcept { return offset_; }
+
+    auto next(LoggedSession& session) noexcept -> bool {
+        while (valid_ and not truncated_ and offset_ < bytes_.size()) {
+            RecordHeader record;
+
+            if (bytes_.size() - offset_ < sizeof(record)) {
+                return stop();
+            }
+
+            std::memcpy(&record, bytes_.data() + offset_, sizeof(record));
+
+            const auto begin = offset_ + sizeof(record);
+
+            if (bytes_.size() - begin < record.size) {
+                return stop();
+            }
+
+            if (record.kind != RecordHeader::session) {
+                offset_ = begin + record.size;
+                continue;
+            }
+
+            if (record.size < sizeof(SessionHeader)) {
+                return stop();
+            }
+
+            const auto* data = bytes_.data() + begin;
+            std::memcpy(&session.header, data, sizeof(SessionHeader));
+
+            const auto& header = session.header;
+
+            if (sizeof(SessionHeader) + uint64_t{header.text_size} +
+                    header.typed_size +
+                    uint64_t{header.keystrokes} * sizeof(LoggedKey) !=
+                record.size) {
+                return stop();
+            }
+
+            offset_ = begin + record.size;
+
+            const auto* text =
+                reinterpret_cast<const char*>(data + sizeof(SessionHeader));
+
+            session.text = {text, header.text_size};
+            session.typed = {text + header.text_size, header.typed_size};
+            session.keys = reinterpret_cast<const std::byte*>(
+                text + header.text_size + header.typed_size);
+
+            return true;
+        }
+
+        return false;
+    }
+
+   private:
+    auto stop() noexcept -> bool {
+        truncated_ = true;
+        return false;
+    }
+
+    std::span<const std::byte> bytes_;
+    std::size_t offset_ = 0;
+    bool valid_ = false;
+    bool truncated_ = false;
+};
+
+// Aggregate scores of replayed sessions, workers keep their own and merge
+// them at the end.
+struct ReplayStats {
+    static constexpr std::size_t speed_bucket = 5;  // wpm per histogram bar
+    static constexpr std::size_t speed_buckets = 41;  // last one is 200+
+
+    uint64_t sessions = 0;
+    uint64_t timed = 0;  // sessions with at least two keystrokes
+    double speed_sum = 0.0;
+    EditCounts characters;
+    EditCounts words;
+    std::array<uint64_t, speed_buckets> speeds{};
+    std::array<uint64_t, 256> occurrences{};  // target characters
+    std::array<uint64_t, 256> errors{};       // substituted or missed
+    bool truncated = false;
+
+    // Scores the session over the characters of its encoding, a session
+    // with any byte outside ascii is aligned as utf-8.
+    auto add(const LoggedSession& session, std::pmr::memory_resource* resource)
+        -> void {
+        if (is_ascii(std::span(session.text)) and
+            is_ascii(std::span(session.typed))) {
+            add<Ascii>(session, resource);
+        } else {
+            add<Utf8>(session, resource);
+        }
+    }
+
+    // Only ascii characters are counted per character, a missed multibyte
+    // character counts toward the errors but toward no table entry.
+    template <class Encoding>
+    auto add(const LoggedSession& session, std::pmr::memory_resource* resource)
+        -> void {
+        std::pmr::vector<uint32_t> missed(resource);
+
+        const Score result{
+            .characters = align_characters<Encoding>(
+                session.text, session.typed, resource, nullptr, &missed),
+            .words = align(split_words(session.text, resource),
+                           split_words(session.typed, resource), resource),
+        };
+
+        ++sessions;
+        characters += result.characters;
+        words += result.words;
+
+        for (const auto c : session.text) {
+            if (static_cast<unsigned char>(c) < 0x80) {
+                ++occurrences[static_cast<unsigned char>(c)];
+            }
+        }
+
+        for (const auto position : missed) {
+            if (static_cast<unsigned char>(session.text[position]) < 0x80) {
+                ++errors[static_cast<unsigned char>(session.text[position])];
+            }
+        }
+
+        if (session.header.keystrokes < 2) {
+            return;
+        }
+
+        const auto speed =
+            typing_speed(encoding_traits<Encoding>::length(session.typed),
+                         session.duration(), "wpm");
+
+        ++timed;
+        speed_sum += speed;
+        ++speeds[std::min(static_cast<std::size_t>(speed) / speed_bucket,
+                          speed_buckets - 1)];
+    }
+
+    auto merge(const ReplayStats& other) noexcept -> void {
+        sessions += other.sessions;
+        timed += other.timed;
+        speed_sum += other.speed_sum;
+        characters += other.characters;
+        words += other.words;
+        truncated = truncated or other.truncated;
+
+        for (std::size_t i = 0; i < speeds.size(); ++i) {
+            speeds[i] += other.speeds[i];
+        }
+
+        for (std::size_t i = 0; i < occurrences.size(); ++i) {
+            occurrences[i] += other.occurrences[i];
+            errors[i] += other.errors[i];
+        }
+    }
+
+    // Lower bound of the speed bucket holding the `fraction` quantile.
+    [[nodiscard]] auto speed_quantile(double fraction) const noexcept
+        -> std::size_t {
+        const auto rank = static_cast<uint64_t>(fraction * timed);
+        uint64_t seen = 0;
+
+        for (std::size_t i = 0; i < speeds.size(); ++i) {
+            seen += speeds[i];
+
+            if (seen > rank) {
+                return i * speed_bucket;
+            }
+        }
+
+        return (speeds.size() - 1) * speed_bucket;
+    }
+};
+
+// Sessions a worker takes from the shared reader at once, keeps the lock
+// out of the scoring loop.
+inline constexpr std::size_t replay_chunk_size = 1024;
+
+// Folds the sessions `reader` has not read yet like the overload below
+// folds a whole log, `reader` is left at the end of the last complete
+// record.
+template <class Stats, class Add>
+auto fold_sessions(LogReader& reader, unsigned threads, Add add)
+    -> std::optional<Stats> {
+    if (not reader.valid()) {
+        return std::nullopt;
+    }
+
+    threads = std::max(threads, 1u);
+
+    std::mutex mutex;
+    std::vector<Stats> stats(threads);
+
+    const auto work = [&](Stats& result) {
+        ThreadArena arena(scoring_arena_size);
+
+        std::vector<LoggedSession> chunk(replay_chunk_size);
+
+        for (;;) {
+            std::size_t size = 0;
+
+            {
+                const std::lock_guard lock(mutex);
+
+                while (size < chunk.size() and reader.next(chunk[size])) {
+                    ++size;
+                }
+            }
+
+            if (not size) {
+                return;
+            }
+
+            for (std::size_t i = 0; i < size; ++i) {
+                add(result, chunk[i], arena.resource());
+                arena.reset();
+            }
+        }
+    };
+
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(threads - 1);
+
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back(work, std::ref(stats[i]));
+        }
+
+        work(stats[0]);
+    }
+
+    for (unsigned i = 1; i < threads; ++i) {
+        stats[0].merge(stats[i]);
+    }
+
+    return std::move(stats[0]);
+}
+
+// Folds every session of `log` into per worker `Stats` with
+// `add(stats, session, resource)` and merges them with `Stats::merge`. The
+// log is only walked once, `threads` workers take chunks of records
+// straight from the mapping and get an arena that is reset after every
+// session. Returns nullopt if `log` is not a session log, `truncated` is
+// set if reading stopped at a malformed record.
+template <class Stats, class Add>
+auto fold_sessions(const MappedFile& log, unsigned threads, Add add,
+                   bool* truncated = nullptr) -> std::optional<Stats> {
+    LogReader reader(log.bytes());
+
+    auto stats = fold_sessions<Stats>(reader, threads, std::move(add));
+
+    if (truncated) {
+        *truncated = reader.truncated();
+    }
+
+    return stats;
+}
+
+// Re-scores every session of `log` with `threads` workers.
+inline auto replay_sessions(const MappedFile& log, unsigned threads)
+    -> std::optional<ReplayStats> {
+    bool truncated = false;
+
+    auto stats = fold_sessions<ReplayStats>(
+        log, threads,
+        [](ReplayStats& stats, const LoggedSession& session,
+           std::pmr::memory_resource* resource) {
+            stats.add(session, resource);
+        },
+        &truncated);
+
+    if (stats) {
+        stats->truncated = truncated;
+    }
+
+    return stats;
+}
+
+// Key and bigram latencies of the sessions `reader` has not read yet.
+inline auto collect_latencies(LogReader& reader, unsigned threads)
+    -> std::optional<KeyLatencies> {
+    return fold_sessions<KeyLatencies>(
+        reader, threads,
+        [](KeyLatencies& latencies, const LoggedSession& session,
+           std::pmr::memory_resource* /*resource*/) {
+            latencies.add(session, session.header.keystrokes);
+        });
+}
+
+// Key and bigram latencies of every session of `log`.
+inline auto collect_latencies(const MappedFile& log, unsigned threads)
+    -> std::optional<KeyLatencies> {
+    LogReader reader(log.bytes());
+    return collect_latencies(reader, threads);
+}
+
+// Latencies folded from the sessions of a log up to byte `offset`, none
+// at offset 0.
+struct LatencyCheckpoint {
+    KeyLatencies latencies;
+    std::size_t offset = 0;
+};
+
+// Latency checkpoint layout after the CacheHeader, histograms as they lie
+// in memory:
+//
+//   CheckpointHeader | LatencyHistogram overall, keys[256],
+//   bigrams[bigrams] | uint16_t ids[bigrams]
+//
+// `hash` covers the `checkpoint_window` log bytes before `offset`, a log
+// that was replaced, rotated or cut short no longer matches it.
+struct CheckpointHeader {
+    uint64_t offset = 0;
+    uint64_t hash = 0;
+    uint64_t bigrams = 0;
+};
+
+static_assert(sizeof(CheckpointHeader) == 24);
+
+inline constexpr std::size_t checkpoint_window = 4096;
+
+namespace detail {
+
+inline constexpr std::string_view checkpoint_extension = ".tpk";
+
+inline auto checkpoint_hash(const MappedFile& log, std::size_t offset)
+    -> uint64_t {
+    const auto window = std::min(offset, checkpoint_window);
+    return xxhash64(log.bytes().subspan(offset - window, window));
+}
+
+}  // namespace detail
+
+// Latencies of `log` folded by an earlier run, stored in `cache` next to
+// the indices of the dictionary of `words` words. A missing checkpoint, or
+// one of another log, folds nothing and starts at offset 0.
+inline auto read_latency_checkpoint(
+    const IndexCache* cache, uint64_t words, const MappedFile& log,
+    const KeyLatencies::allocator_type& allocator = {}) -> LatencyCheckpoint {
+    LatencyCheckpoint checkpoint{.latencies = KeyLatencies(allocator)};
+
+    constexpr auto fixed = sizeof(CacheHeader) + sizeof(CheckpointHeader) +
+                           (1 + 256) * sizeof(LatencyHistogram);
+    constexpr auto entry = sizeof(LatencyHistogram) + sizeof(uint16_t);
+
+    const auto file =
+        cache ? cache->read(detail::checkpoint_extension,
+                            CacheHeader::latencies, words)
+              : std::nullopt;
+
+    if (not file or file->size() < fixed) {
+        return checkpoint;
+    }
+
+    const auto* data = file->bytes().data() + sizeof(CacheHeader);
+
+    CheckpointHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.offset > log.size() or
+        header.bigrams > BigramIndex::bigram_count or
+        file->size() != fixed + header.bigrams * entry or
+        header.hash != detail::checkpoint_hash(log, header.offset)) {
+        return checkpoint;
+    }
+
+    auto& latencies = checkpoint.latencies;
+    const auto* histograms = data + sizeof(header);
+    const auto* ids = histograms + (1 + 256 + header.bigrams) *
+                                       sizeof(LatencyHistogram);
+
+    const auto histogram = [&](uint64_t i) {
+        LatencyHistogram histogram;
+        std::memcpy(&histogram, histograms + i * sizeof(histogram),
+                    sizeof(histogram));
+        return histogram;
+    };
+
+    latencies.overall().merge(histogram(0));
+
+    for (std::size_t c = 0; c < 256; ++c) {
+        latencies.keys()[c].merge(histogram(1 + c));
+    }
+
+    latencies.bigrams().reserve(header.bigrams);
+
+    for (uint64_t i = 0; i < header.bigrams; ++i) {
+        uint16_t id = 0;
+        std::memcpy(&id, ids + i * sizeof(id), sizeof(id));
+        latencies.bigrams()[id].merge(histogram(1 + 256 + i));
+    }
+
+    checkpoint.offset = header.offset;
+    return checkpoint;
+}
+
+// Stores `latencies`, folded from `log` up to byte `offset`, in `cache`
+// for the next run to resume from.
+inline auto write_latency_checkpoint(const IndexCache* cache, uint64_t words,
+                                     const MappedFile& log,
+                                     const KeyLatencies& latencies,
+                                     std::size_t offset) -> bool {
+    if (not cache) {
+        return false;
+    }
+
+    std::vector<LatencyHistogram> histograms;
+    std::vector<uint16_t> ids;
+    histograms.reserve(latencies.bigrams().size());
+    ids.reserve(latencies.bigrams().size());
+
+    for (const auto& [id, histogram] : latencies.bigrams()) {
+        histograms.push_back(histogram);
+        ids.push_back(id);
+    }
+
+    const CheckpointHeader header{
+        .offset = offset,
+        .hash = detail::checkpoint_hash(log, offset),
+        .bigrams = ids.size(),
+    };
+
+    return cache->write(detail::checkpoint_extension, CacheHeader::latencies,
+                        words,
+                        {std::as_bytes(std::span(&header, 1)),
+                         std::as_bytes(std::span(&latencies.overall(), 1)),
+                         std::as_bytes(latencies.keys()),
+                         std::as_bytes(std::span(histograms)),
+                         std::as_bytes(std::span(ids))});
+}
+
+// Appends a compact table of `stats` to `out`: throughput, the speed
+// distribution and the characters mistyped most often.
+inline auto render_replay(const ReplayStats& stats,
+                          std::chrono::nanoseconds elapsed,
+                          fmt::memory_buffer& out) -> void {
+    const auto to = std::back_inserter(out);
+    const auto seconds = std::chrono::duration<double>(elapsed).count();
+
+    fmt::format_to(to, "Sessions: {} in {:.3f}s ({:.0f} sessions/s){}\n",
+                   stats.sessions, seconds,
+                   seconds > 0.0 ? stats.sessions / seconds : 0.0,
+                   stats.truncated ? ", log is truncated" : "");
+
+    uint64_t typed = 0;
+
+    for (const auto count : stats.occurrences) {
+        typed += count;
+    }
+
+    const auto percent = [](uint64_t part, uint64_t whole) {
+        return whole ? 100.0 * part / whole : 0.0;
+    };
+
+    fmt::format_to(to,
+                   "Errors: {} ({} wrong, {} extra, {} missed), {:.2f}% of "
+                   "{} characters, wrong words: {}\n",
+                   stats.characters.total(), stats.characters.substitutions,
+                   stats.characters.insertions, stats.characters.deletions,
+                   percent(stats.characters.substitutions +
+                               stats.characters.deletions,
+                           typed),
+                   typed, stats.words.total());
+
+    if (stats.timed) {
+        fmt::format_to(to, "\nwpm: mean {:.1f}, p50 {}, p90 {}, p99 {}\n",
+                       stats.speed_sum / stats.timed,
+                       stats.speed_quantile(0.5), stats.speed_quantile(0.9),
+                       stats.speed_quantile(0.99));
+
+        const auto most = *std::ranges::max_element(stats.speeds);
+
+        for (std::size_t i = 0; i < stats.speeds.size(); ++i) {
+            if (not stats.speeds[i]) {
+                continue;
+            }
+
+            const auto low = i * ReplayStats::speed_bucket;
+            const auto bar = static_cast<std::size_t>(
+                (40 * stats.speeds[i] + most - 1) / most);
+
+            if (i + 1 == stats.speeds.size()) {
+                fmt::format_to(to, "  {:>3}+    ", low);
+            } else {
+                fmt::format_to(to, "  {:>3}-{:<3} ", low,
+                               low + ReplayStats::speed_bucket - 1);
+            }
+
+            fmt::format_to(to, "{:>8} {:5.1f}% {:#<{}}\n", stats.speeds[i],
+                           percent(stats.speeds[i], stats.timed), "", bar);
+        }
+    }
+
+    std::array<unsigned char, 256> characters;
+
+    for (std::size_t i = 0; i < characters.size(); ++i) {
+        characters[i] = static_cast<unsigned char>(i);
+    }
+
+    const auto rate = [&stats](unsigned char c) {
+        return stats.occurrences[c]
+                   ? static_cast<double>(stats.errors[c]) / stats.occurrences[c]
+                   : 0.0;
+    };
+
+    std::ranges::sort(characters, [&rate](unsigned char a, unsigned char b) {
+        return rate(a) > rate(b);
+    });
+
+    fmt::format_to(to, "\n  char  errors     typed   rate\n");
+
+    for (const auto c : characters | std::views::take(10)) {
+        if (not stats.errors[c]) {
+            break;
+        }
+
+        const auto shown = c == ' ' ? std::string_view("' '")
+                                    : std::string_view(
+                                          reinterpret_cast<const char*>(&c), 1);
+
+        fmt::format_to(to, "  {:>4} {:>7} {:>9} {:5.1f}%\n", shown,
+                       stats.errors[c], stats.occurrences[c],
+                       100.0 * rate(c));
+    }
+}
+
+}  // namespace tpr
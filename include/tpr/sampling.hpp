@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory_resource>
+#include <random>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+#include "length_index.hpp"
+
+namespace tpr {
+
+// Floyd's algorithm, appends `min(k, n)` distinct positions from [0, n) to
+// `out` using O(k) time and memory regardless of `n`.
+template <class URBG>
+auto floyd_sample(std::size_t n, std::size_t k, URBG& rng,
+                  std::pmr::vector<uint32_t>& out) -> void {
+    k = std::min(k, n);
+
+    std::pmr::unordered_set<uint32_t> taken(out.get_allocator());
+    taken.reserve(k);
+    out.reserve(out.size() + k);
+
+    for (auto j = n - k; j < n; ++j) {
+        const auto t = static_cast<uint32_t>(
+            std::uniform_int_distribution<std::size_t>(0, j)(rng));
+        const auto pick = taken.insert(t).second ? t : static_cast<uint32_t>(j);
+
+        if (pick != t) {
+            taken.insert(pick);
+        }
+
+        out.push_back(pick);
+    }
+}
+
+namespace detail {
+
+// Scratch space of `build_alias_table`, kept by callers building many
+// small tables so they allocate once.
+struct AliasScratch {
+    explicit AliasScratch(std::pmr::memory_resource* resource =
+                              std::pmr::get_default_resource())
+        : small(resource), large(resource), scaled(resource) {}
+
+    std::pmr::vector<uint32_t> small;
+    std::pmr::vector<uint32_t> large;
+    std::pmr::vector<double> scaled;
+};
+
+// Vose's construction of an alias table for `weights` into `probability`
+// and `alias` of the same size, `alias` holding positions into them. The
+// arithmetic is done in double and rounded to `Probability` once. A table
+// of weights summing to zero is left untouched.
+template <class Probability>
+auto build_alias_table(std::span<const double> weights,
+                       std::span<Probability> probability,
+                       std::span<uint32_t> alias, AliasScratch& scratch)
+    -> void {
+    double total = 0.0;
+
+    for (const auto weight : weights) {
+        total += weight;
+    }
+
+    if (weights.empty() or total <= 0.0) {
+        return;
+    }
+
+    const auto n = static_cast<double>(weights.size());
+
+    auto& [small, large, scaled] = scratch;
+    small.clear();
+    large.clear();
+    scaled.resize(weights.size());
+
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+        scaled[i] = weights[i] * n / total;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+
+    while (not small.empty() and not large.empty()) {
+        const auto less = small.back();
+        const auto more = large.back();
+        small.pop_back();
+
+        alias[less] = more;
+        scaled[more] -= 1.0 - scaled[less];
+
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    // leftovers are 1 up to rounding errors
+    for (const auto i : large) {
+        scaled[i] = 1.0;
+    }
+
+    for (const auto i : small) {
+        scaled[i] = 1.0;
+    }
+
+    std::ranges::transform(scaled, probability.begin(), [](double p) {
+        return static_cast<Probability>(p);
+    });
+}
+
+}  // namespace detail
+
+// Vose's alias method: O(n) construction, O(1) draw proportional to
+// `weights[i]`.
+class AliasTable {
+   public:
+    using allocator_type = std::pmr::polymorphic_allocator<double>;
+
+    explicit AliasTable(std::span<const double> weights,
+                        const allocator_type& allocator = {})
+        : probability_(weights.size(), 0.0, allocator),
+          alias_(weights.size(), 0, allocator) {
+        detail::AliasScratch scratch(allocator.resource());
+        detail::build_alias_table<double>(weights, probability_, alias_,
+                                          scratch);
+    }
+
+    [[nodiscard]] auto size() const noexcept { return probability_.size(); }
+    [[nodiscard]] auto empty() const noexcept { return probability_.empty(); }
+
+    template <class URBG>
+    auto operator()(URBG& rng) const -> std::size_t {
+        const auto column =
+            std::uniform_int_distribution<std::size_t>(0, size() - 1)(rng);
+        const auto coin = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+
+        return coin < probability_[column] ? column : alias_[column];
+    }
+
+   private:
+    std::pmr::vector<double> probability_;
+    std::pmr::vector<uint32_t> alias_;
+};
+
+// Frequency weighted draws (with replacement) from a set of candidates,
+// word ranked `r` in the dictionary is drawn with weight `1 / (r + 1)`. An
+// alias table picks the length bucket, a binary search over the bucket's
+// running sums picks the word, so a draw costs O(log bucket) at most.
+class RankSampler {
+   public:
+    using allocator_type = AliasTable::allocator_type;
+
+    explicit RankSampler(const Candidates& candidates,
+                         const allocator_type& allocator = {})
+        : candidates_(candidates),
+          buckets_(bucket_weights(candidates, allocator), allocator) {}
+
+    [[nodiscard]] auto empty() const noexcept { return buckets_.empty(); }
+
+    // Returns a word index.
+    template <class URBG>
+    auto operator()(URBG& rng) const -> uint32_t {
+        const auto bucket = buckets_(rng);
+        const auto sums = candidates_.weights()[bucket];
+
+        const auto target =
+            std::uniform_real_distribution<double>(0.0, sums.back())(rng);
+        const auto position = std::min<std::size_t>(
+            std::ranges::upper_bound(sums, target) - sums.begin(),
+            sums.size() - 1);
+
+        return candidates_.ranges()[bucket][position];
+    }
+
+   private:
+    // candidate ranges are bucket prefixes, so the last running sum is the
+    // weight of the whole range
+    static auto bucket_weights(const Candidates& candidates,
+                               const allocator_type& allocator)
+        -> std::pmr::vector<double> {
+        std::pmr::vector<double> weights(allocator);
+        weights.reserve(candidates.weights().size());
+
+        for (const auto sums : candidates.weights()) {
+            weights.push_back(sums.back());
+        }
+
+        return weights;
+    }
+
+    const Candidates& candidates_;
+    AliasTable buckets_;
+};
+
+// Binary indexed (Fenwick) tree over weights: O(n) construction, O(log n)
+// weight updates and O(log n) draws proportional to `weights[i]`, for
+// samplers whose weights change after they are built.
+class FenwickTree {
+   public:
+    using allocator_type = std::pmr::polymorphic_allocator<double>;
+
+    explicit FenwickTree(std::span<const double> weights,
+                         const allocator_type& allocator = {})
+        : weights_(weights.begin(), weights.end(), allocator),
+          tree_(weights.size() + 1, 0.0, allocator) {
+        for (std::size_t i = 1; i < tree_.size(); ++i) {
+            tree_[i] += weights_[i - 1];
+
+            if (const auto parent = i + (i & (~i + 1)); parent < tree_.size()) {
+                tree_[parent] += tree_[i];
+            }
+        }
+    }
+
+    [[nodiscard]] auto size() const noexcept { return weights_.size(); }
+    [[nodiscard]] auto empty() const noexcept { return weights_.empty(); }
+
+    [[nodiscard]] auto weight(std::size_t i) const noexcept {
+        return weights_[i];
+    }
+
+    auto set(std::size_t i, double weight) noexcept -> void {
+        const auto delta = weight - weights_[i];
+        weights_[i] = weight;
+
+        for (auto j = i + 1; j < tree_.size(); j += j & (~j + 1)) {
+            tree_[j] += delta;
+        }
+    }
+
+    // Sum of the first `count` weights.
+    [[nodiscard]] auto prefix(std::size_t count) const noexcept -> double {
+        double sum = 0.0;
+
+        for (; count; count &= count - 1) {
+            sum += tree_[count];
+        }
+
+        return sum;
+    }
+
+    [[nodiscard]] auto total() const noexcept { return prefix(size()); }
+
+    // Position whose weight covers `target` in [0, total()).
+    [[nodiscard]] auto find(double target) const noexcept -> std::size_t {
+        std::size_t position = 0;
+
+        for (auto step = std::bit_floor(size()); step; step >>= 1) {
+            if (position + step < tree_.size() and
+                tree_[position + step] <= target) {
+                position += step;
+                target -= tree_[position];
+            }
+        }
+
+        return std::min(position, size() - 1);
+    }
+
+    template <class URBG>
+    auto operator()(URBG& rng) const -> std::size_t {
+        return find(std::uniform_real_distribution<double>(0.0, total())(rng));
+    }
+
+   private:
+    std::pmr::vector<double> weights_;
+    std::pmr::vector<double> tree_;
+};
+
+}  // namespace tpr
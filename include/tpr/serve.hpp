@@ -0,0 +1,864 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "alignment.hpp"
+#include "arena.hpp"
+#include "encoding.hpp"
+#include "generator.hpp"
+#include "input.hpp"
+#include "random.hpp"
+#include "snapshot.hpp"
+
+namespace tpr {
+
+// Address given to --serve as "[host]:port", an empty host listens on
+// every interface.
+struct ServeAddress {
+    std::string host;
+    uint16_t port = 0;
+};
+
+inline auto parse_serve_address(std::string_view text)
+    -> std::optional<ServeAddress> {
+    const auto colon = text.rfind(':');
+
+    if (colon == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    const auto digits = text.substr(colon + 1);
+    uint16_t port = 0;
+
+    const auto [end, error] =
+        std::from_chars(digits.data(), digits.data() + digits.size(), port);
+
+    if (digits.empty() or error != std::errc{} or
+        end != digits.data() + digits.size()) {
+        return std::nullopt;
+    }
+
+    auto host = text.substr(0, colon);
+
+    // [::1]:8080
+    if (host.starts_with('[') and host.ends_with(']')) {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    return ServeAddress{std::string(host), port};
+}
+
+// Larger requests are answered with 413 and their connection is closed.
+inline constexpr std::size_t max_request_head = 8 * 1024;
+inline constexpr std::size_t max_request_body = 1024 * 1024;
+
+// Longest an idle serving thread waits for events. It then picks up a
+// newly published generator, so the replaced one is freed even if the
+// thread gets no request.
+inline constexpr std::chrono::milliseconds idle_refresh_interval{1000};
+
+// Responses waiting for a client which does not read them. Past this its
+// pipelined requests are left unread until the responses are sent.
+inline constexpr std::size_t max_pending_response = 1024 * 1024;
+
+// Words of a served test, bounds the time a single request can take.
+inline constexpr uint64_t max_served_words = 10'000;
+
+// Characters of each text scored, longer ones are answered with 413.
+// Aligning two unrelated texts takes time quadratic in their length, this
+// keeps the worst request to about half a second.
+inline constexpr std::size_t max_scored_characters = 8 * 1024;
+
+namespace detail {
+
+struct HttpRequest {
+    std::string_view method;
+    std::string_view path;
+    std::string_view query;
+    std::string_view body;
+    bool close = false;
+    std::size_t size = 0;  // of the head and the body
+};
+
+enum class ParseStatus : uint8_t { incomplete, complete, invalid, too_large };
+
+inline auto equals_ignoring_case(std::string_view lhs,
+                                 std::string_view rhs) noexcept -> bool {
+    return std::ranges::equal(lhs, rhs, [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) ==
+               std::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+inline auto trim(std::string_view text) noexcept -> std::string_view {
+    while (not text.empty() and (text.front() == ' ' or text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+
+    while (not text.empty() and (text.back() == ' ' or text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+
+    return text;
+}
+
+template <class Integer>
+auto parse_integer(std::string_view text) noexcept -> std::optional<Integer> {
+    Integer value{};
+
+    const auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+
+    if (text.empty() or error != std::errc{} or
+        end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+// Parses the HTTP/1.x request at the start of `in`. Chunked bodies are
+// not supported, clients send a Content-Length.
+inline auto parse_request(std::string_view in, HttpRequest& request)
+    -> ParseStatus {
+    const auto head_end = in.find("\r\n\r\n");
+
+    if (head_end == std::string_view::npos) {
+        return in.size() > max_request_head ? ParseStatus::too_large
+                                            : ParseStatus::incomplete;
+    }
+
+    if (head_end > max_request_head) {
+        return ParseStatus::too_large;
+    }
+
+    const auto head = in.substr(0, head_end);
+    const auto line_end = std::min(head.find("\r\n"), head.size());
+    const auto line = head.substr(0, line_end);
+
+    // method SP target SP version
+    const auto first = line.find(' ');
+    const auto second = first == std::string_view::npos
+                            ? std::string_view::npos
+                            : line.find(' ', first + 1);
+
+    if (second == std::string_view::npos) {
+        return ParseStatus::invalid;
+    }
+
+    const auto target = line.substr(first + 1, second - first - 1);
+    const auto version = line.substr(second + 1);
+
+    if (not version.starts_with("HTTP/1.")) {
+        return ParseStatus::invalid;
+    }
+
+    const auto question = target.find('?');
+
+    request.method = line.substr(0, first);
+    request.path = target.substr(0, question);
+    request.query = question == std::string_view::npos
+                        ? std::string_view{}
+                        : target.substr(question + 1);
+    request.close = version == "HTTP/1.0";
+
+    std::size_t content_length = 0;
+
+    for (auto rest = head.substr(std::min(line_end + 2, head.size()));
+         not rest.empty();) {
+        const auto end = std::min(rest.find("\r\n"), rest.size());
+        const auto header = rest.substr(0, end);
+        const auto colon = header.find(':');
+
+        rest.remove_prefix(std::min(end + 2, rest.size()));
+
+        if (colon == std::string_view::npos) {
+            return ParseStatus::invalid;
+        }
+
+        const auto name = header.substr(0, colon);
+        const auto value = trim(header.substr(colon + 1));
+
+        if (equals_ignoring_case(name, "content-length")) {
+            const auto length = parse_integer<std::size_t>(value);
+
+            if (not length) {
+                return ParseStatus::invalid;
+            }
+
+            content_length = *length;
+        } else if (equals_ignoring_case(name, "connection")) {
+            if (equals_ignoring_case(value, "close")) {
+                request.close = true;
+            } else if (equals_ignoring_case(value, "keep-alive")) {
+                request.close = false;
+            }
+        } else if (equals_ignoring_case(name, "transfer-encoding")) {
+            return ParseStatus::invalid;
+        }
+    }
+
+    if (content_length > max_request_body) {
+        return ParseStatus::too_large;
+    }
+
+    const auto body = head_end + 4;
+
+    if (in.size() < body + content_length) {
+        return ParseStatus::incomplete;
+    }
+
+    request.body = in.substr(body, content_length);
+    request.size = body + content_length;
+
+    return ParseStatus::complete;
+}
+
+// Value of `key` in an url query, values are not percent decoded since
+// every parameter is a number or a plain word.
+inline auto query_value(std::string_view query, std::string_view key) noexcept
+    -> std::optional<std::string_view> {
+    while (not query.empty()) {
+        const auto end = std::min(query.find('&'), query.size());
+        const auto pair = query.substr(0, end);
+        const auto equals = std::min(pair.find('='), pair.size());
+
+        if (pair.substr(0, equals) == key) {
+            return pair.substr(std::min(equals + 1, pair.size()));
+        }
+
+        query.remove_prefix(std::min(end + 1, query.size()));
+    }
+
+    return std::nullopt;
+}
+
+inline auto append_response(std::string& out, std::string_view status,
+                            std::string_view type, std::string_view body,
+                            bool close) -> void {
+    fmt::format_to(std::back_inserter(out),
+                   "HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+                   "{}\r\n",
+                   status, type, body.size(),
+                   close ? "Connection: close\r\n" : "");
+    out.append(body);
+}
+
+}  // namespace detail
+
+#if defined(__linux__)
+
+namespace detail {
+
+// Bound, listening, non blocking socket. Every serving thread has its own
+// on the same port (SO_REUSEPORT), the kernel spreads connections.
+inline auto open_listener(const ServeAddress& address, uint16_t port) -> int {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo* found = nullptr;
+    const auto service = fmt::format("{}", port);
+
+    if (getaddrinfo(address.host.empty() ? nullptr : address.host.c_str(),
+                    service.c_str(), &hints, &found) != 0) {
+        return -1;
+    }
+
+    int listener = -1;
+
+    for (auto* info = found; info and listener < 0; info = info->ai_next) {
+        listener = socket(info->ai_family,
+                          info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          info->ai_protocol);
+
+        if (listener < 0) {
+            continue;
+        }
+
+        const int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+        if (bind(listener, info->ai_addr, info->ai_addrlen) != 0 or
+            listen(listener, SOMAXCONN) != 0) {
+            close(listener);
+            listener = -1;
+        }
+    }
+
+    freeaddrinfo(found);
+    return listener;
+}
+
+inline auto bound_port(int listener) -> uint16_t {
+    sockaddr_storage address{};
+    socklen_t size = sizeof(address);
+
+    if (getsockname(listener, reinterpret_cast<sockaddr*>(&address), &size) !=
+        0) {
+        return 0;
+    }
+
+    return ntohs(address.ss_family == AF_INET6
+                     ? reinterpret_cast<const sockaddr_in6&>(address).sin6_port
+                     : reinterpret_cast<const sockaddr_in&>(address).sin_port);
+}
+
+// `in` holds at most one request and a read more, `out` at most
+// max_pending_response and one response more.
+struct Connection {
+    std::string in;
+    std::string out;
+    std::size_t sent = 0;
+    uint32_t events = EPOLLIN | EPOLLRDHUP;  // watched
+    bool ended = false;    // the client sent everything
+    bool closing = false;  // close once `out` is sent
+    bool writing = false;  // waiting for EPOLLOUT
+
+    [[nodiscard]] auto pending() const noexcept -> std::size_t {
+        return out.size() - sent;
+    }
+};
+
+// One serving thread: an epoll loop over its listener and connections.
+// Requests are answered in the order they arrive, pipelined ones too. A
+// newly published generator is picked up between two batches of events,
+// or after idle_refresh_interval without any, so every request runs on the
+// one it started with.
+template <class Char, class Engine>
+class ServeWorker {
+   public:
+    using generator_type = TestGenerator<Char, Engine>;
+
+    ServeWorker(const SnapshotSlot<generator_type>& generators,
+                const TestConfig& defaults, std::string_view unit,
+                Engine engine, int listener)
+        : generators_(generators),
+          defaults_(defaults),
+          unit_(unit),
+          engine_(engine),
+          arena_(scoring_arena_size),
+          listener_(listener),
+          epoll_(epoll_create1(EPOLL_CLOEXEC)) {}
+
+    ServeWorker(const ServeWorker&) = delete;
+    auto operator=(const ServeWorker&) -> ServeWorker& = delete;
+
+    ~ServeWorker() {
+        for (const auto& [fd, connection] : connections_) {
+            close(fd);
+        }
+
+        if (epoll_ >= 0) {
+            close(epoll_);
+        }
+
+        close(listener_);
+    }
+
+    // Returns only if epoll fails.
+    auto run() -> void {
+        if (epoll_ < 0 or not watch(listener_, EPOLL_CTL_ADD, EPOLLIN)) {
+            return;
+        }
+
+        std::array<epoll_event, 256> events;
+
+        for (;;) {
+            const int ready =
+                epoll_wait(epoll_, events.data(), events.size(),
+                           static_cast<int>(idle_refresh_interval.count()));
+
+            if (ready < 0 and errno == EINTR) {
+                continue;
+            }
+
+            if (ready < 0) {
+                return;
+            }
+
+            generator_ = &generators_.refresh();
+
+            for (const auto& event :
+                 std::span{events.data(), static_cast<std::size_t>(ready)}) {
+                if (event.data.fd == listener_) {
+                    accept_all();
+                } else {
+                    handle(event.data.fd, event.events);
+                }
+            }
+        }
+    }
+
+   private:
+    auto watch(int fd, int operation, uint32_t events) -> bool {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_, operation, fd, &event) == 0;
+    }
+
+    auto accept_all() -> void {
+        for (;;) {
+            const int fd =
+                accept4(listener_, nullptr, nullptr,
+                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (fd < 0) {
+                return;
+            }
+
+            const int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            if (not watch(fd, EPOLL_CTL_ADD, Connection{}.events)) {
+                close(fd);
+                continue;
+            }
+
+            connections_.try_emplace(fd);
+        }
+    }
+
+    auto handle(int fd, uint32_t events) -> void {
+        const auto found = connections_.find(fd);
+
+        if (found == connections_.end()) {
+            return;
+        }
+
+        auto& connection = found->second;
+
+        bool open = not(events & EPOLLERR);
+
+        if (open and events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+            open = receive(fd, connection);
+        }
+
+        if (open and connection.writing) {
+            open = send(fd, connection);
+        }
+
+        // answering stops at max_pending_response, what it left is
+        // answered once the socket took the responses
+        for (bool paused = true; open and paused and not connection.writing;) {
+            paused = answer(connection);
+            open = send(fd, connection);
+        }
+
+        if (open) {
+            open = update(fd, connection);
+        }
+
+        if (not open) {
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            connections_.erase(found);
+        }
+    }
+
+    // Reads what is available until `in` holds the largest request, which
+    // is then complete or answered with 413.
+    auto receive(int fd, Connection& connection) -> bool {
+        constexpr auto largest = max_request_head + 4 + max_request_body;
+
+        std::array<char, 16 * 1024> buffer;
+
+        while (connection.in.size() < largest) {
+            const auto read = recv(fd, buffer.data(), buffer.size(), 0);
+
+            if (read > 0) {
+                connection.in.append(buffer.data(),
+                                     static_cast<std::size_t>(read));
+                continue;
+            }
+
+            if (read == 0) {
+                connection.ended = true;
+                break;
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN or errno == EWOULDBLOCK) {
+                break;
+            }
+
+            return false;
+        }
+
+        return true;
+    }
+
+    // Answers the complete requests of `in`. Returns true if it stopped
+    // at max_pending_response with requests possibly left.
+    auto answer(Connection& connection) -> bool {
+        std::size_t consumed = 0;
+        bool paused = false;
+
+        while (not connection.closing) {
+            if (connection.pending() >= max_pending_response) {
+                paused = true;
+                break;
+            }
+
+            HttpRequest request;
+            const auto status = parse_request(
+                std::string_view(connection.in).substr(consumed), request);
+
+            if (status == ParseStatus::incomplete) {
+                break;
+            }
+
+            if (status != ParseStatus::complete) {
+                append_response(connection.out,
+                                status == ParseStatus::too_large
+                                    ? "413 Content Too Large"
+                                    : "400 Bad Request",
+                                "text/plain", "malformed request\n", true);
+                connection.closing = true;
+                break;
+            }
+
+            respond(request, connection.out);
+            consumed += request.size;
+
+            if (request.close) {
+                connection.closing = true;
+                break;
+            }
+        }
+
+        connection.in.erase(0, consumed);
+        connection.closing =
+            connection.closing or (connection.ended and not paused);
+
+        return paused;
+    }
+
+    // Writes as much of the pending output as the socket takes.
+    auto send(int fd, Connection& connection) -> bool {
+        while (connection.sent < connection.out.size()) {
+            const auto written =
+                ::send(fd, connection.out.data() + connection.sent,
+                       connection.out.size() - connection.sent, MSG_NOSIGNAL);
+
+            if (written >= 0) {
+                connection.sent += static_cast<std::size_t>(written);
+                continue;
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EAGAIN and errno != EWOULDBLOCK) {
+                return false;
+            }
+
+            connection.writing = true;
+            return true;
+        }
+
+        connection.out.clear();
+        connection.sent = 0;
+        connection.writing = false;
+
+        return not connection.closing;
+    }
+
+    // Watches for output room while responses wait, and for requests
+    // unless answering is paused or the connection is closing.
+    auto update(int fd, Connection& connection) -> bool {
+        const bool reading = not connection.closing and
+                             connection.pending() < max_pending_response;
+
+        const uint32_t events =
+            (reading ? EPOLLIN | EPOLLRDHUP : 0u) |
+            (connection.writing ? EPOLLOUT : 0u);
+
+        if (events == connection.events) {
+            return true;
+        }
+
+        connection.events = events;
+        return watch(fd, EPOLL_CTL_MOD, events);
+    }
+
+    auto respond(const HttpRequest& request, std::string& out) -> void {
+        const bool generating = request.path == "/generate";
+        const bool scoring = request.path == "/score";
+
+        if (not generating and not scoring) {
+            append_response(out, "404 Not Found", "text/plain",
+                            "unknown path, use /generate or /score\n",
+                            request.close);
+        } else if (request.method != (generating ? "GET" : "POST")) {
+            append_response(out, "405 Method Not Allowed", "text/plain",
+                            generating ? "use GET\n" : "use POST\n",
+                            request.close);
+        } else if (generating) {
+            generate(request, out);
+        } else {
+            score(request, out);
+        }
+
+        arena_.reset();
+    }
+
+    // GET /generate?amount=&top=&min=&max=&distribution=&seed=
+    auto generate(const HttpRequest& request, std::string& out) -> void {
+        auto config = defaults_;
+        bool valid = true;
+
+        const auto number = [&](std::string_view key, uint64_t& value) {
+            if (const auto text = query_value(request.query, key)) {
+                const auto parsed = parse_integer<uint64_t>(*text);
+                valid = valid and parsed;
+                value = parsed.value_or(value);
+            }
+        };
+
+        number("amount", config.amount);
+        number("top", config.top);
+        number("min", config.min_length);
+        number("max", config.max_length);
+
+        if (const auto distribution =
+                query_value(request.query, "distribution")) {
+            valid = valid and (*distribution == "uniform" or
+                               *distribution == "zipf");
+            config.weighted = *distribution == "zipf";
+        }
+
+        std::optional<Engine> seeded;
+
+        if (const auto seed = query_value(request.query, "seed")) {
+            const auto parsed = parse_integer<uint64_t>(*seed);
+            valid = valid and parsed;
+            seeded = make_engine<Engine>(parsed.value_or(0));
+        }
+
+        if (not valid or not config.amount or
+            config.amount > max_served_words or
+            (config.max_length and config.min_length > config.max_length)) {
+            append_response(out, "400 Bad Request", "text/plain",
+                            "invalid parameters\n", request.close);
+            return;
+        }
+
+        const auto test =
+            generator_->generate(config, seeded ? *seeded : engine_,
+                                 arena_.resource());
+
+        if (test.empty()) {
+            append_response(out, "422 Unprocessable Content", "text/plain",
+                            "no words match the length limits\n",
+                            request.close);
+            return;
+        }
+
+        append_response(out, "200 OK", "text/plain; charset=utf-8",
+                        {test.data(), test.size()}, request.close);
+    }
+
+    // POST /score?ms=  with the body `target "\n" typed`
+    auto score(const HttpRequest& request, std::string& out) -> void {
+        const auto newline = request.body.find('\n');
+
+        if (newline == std::string_view::npos) {
+            append_response(out, "400 Bad Request", "text/plain",
+                            "body must be the target and the typed text on "
+                            "two lines\n",
+                            request.close);
+            return;
+        }
+
+        auto target = request.body.substr(0, newline);
+        auto typed = request.body.substr(newline + 1);
+
+        for (auto* text : {&target, &typed}) {
+            while (text->ends_with('\n') or text->ends_with('\r')) {
+                text->remove_suffix(1);
+            }
+        }
+
+        // from the client, not the dictionary, so checked per request
+        const bool ascii = is_ascii(std::span(request.body));
+        auto* const arena = arena_.resource();
+
+        const auto length = [&](std::string_view text) {
+            return ascii ? encoding_traits<Ascii>::length(text)
+                         : encoding_traits<Utf8>::length(text);
+        };
+
+        if (std::max(length(target), length(typed)) > max_scored_characters) {
+            append_response(out, "413 Content Too Large", "text/plain",
+                            "texts are too long to score\n", request.close);
+            return;
+        }
+
+        const Score result{
+            .characters =
+                ascii ? align_characters<Ascii>(target, typed, arena)
+                      : align_characters<Utf8>(target, typed, arena),
+            .words = align(split_words(target, arena),
+                           split_words(typed, arena), arena),
+        };
+
+        fmt::memory_buffer body;
+        const auto to = std::back_inserter(body);
+
+        fmt::format_to(to,
+                       "{{\"errors\": {}, \"wrong\": {}, \"extra\": {}, "
+                       "\"missed\": {}, \"wrong_words\": {}",
+                       result.characters.total(),
+                       result.characters.substitutions,
+                       result.characters.insertions,
+                       result.characters.deletions, result.words.total());
+
+        if (const auto milliseconds = query_value(request.query, "ms")) {
+            const auto parsed = parse_integer<uint64_t>(*milliseconds);
+
+            if (not parsed) {
+                append_response(out, "400 Bad Request", "text/plain",
+                                "invalid parameters\n", request.close);
+                return;
+            }
+
+            const auto speed = typing_speed(
+                length(typed), std::chrono::milliseconds(*parsed), unit_);
+
+            fmt::format_to(to, ", \"speed\": {:.2f}, \"unit\": \"{}\"",
+                           speed, unit_);
+        }
+
+        fmt::format_to(to, "}}\n");
+
+        append_response(out, "200 OK", "application/json",
+                        {body.data(), body.size()}, request.close);
+    }
+
+    SnapshotReader<generator_type> generators_;
+    const generator_type* generator_ = nullptr;
+    const TestConfig& defaults_;
+    std::string_view unit_;
+    Engine engine_;
+    ThreadArena arena_;  // reset after each request
+    int listener_;
+    int epoll_;
+    std::unordered_map<int, Connection> connections_;
+};
+
+}  // namespace detail
+
+#endif
+
+// Serves tests of the latest of `generators` over HTTP/1.1 with keep-alive:
+//
+//   GET  /generate?amount=&top=&min=&max=&distribution=&seed=
+//        the test as text, missing parameters are taken from `defaults`
+//   POST /score?ms=
+//        body: the target and the typed text on two lines, each of at most
+//        max_scored_characters characters. Replies with json edit counts,
+//        and the speed in `unit` if `ms` is given.
+//
+// Every thread runs its own epoll loop with its own socket, engine and
+// arena. Generators are shared read only through `generators`, another
+// one can be published at any time: requests never take a lock and the
+// replaced generator is freed once no thread uses it. `ready(port)` is
+// called once every socket listens. Returns false if the address can not
+// be bound or the platform has no epoll, otherwise it only returns if every
+// loop failed.
+template <class Char, class Engine, class Ready>
+auto serve(const SnapshotSlot<TestGenerator<Char, Engine>>& generators,
+           const TestConfig& defaults, const ServeAddress& address,
+           unsigned threads, uint64_t seed, std::string_view unit,
+           Ready&& ready) -> bool {
+    static_assert(sizeof(Char) == 1, "tests are served as bytes");
+
+#if defined(__linux__)
+    threads = std::max(threads, 1u);
+
+    std::vector<int> listeners{detail::open_listener(address, address.port)};
+
+    if (listeners.front() < 0) {
+        return false;
+    }
+
+    const auto port = detail::bound_port(listeners.front());
+
+    while (listeners.size() < threads and listeners.back() >= 0) {
+        listeners.push_back(detail::open_listener(address, port));
+    }
+
+    if (listeners.back() < 0) {
+        listeners.pop_back();
+
+        for (const auto listener : listeners) {
+            close(listener);
+        }
+
+        return false;
+    }
+
+    ready(port);
+
+    std::vector<std::jthread> workers;
+    workers.reserve(threads);
+
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            detail::ServeWorker<Char, Engine>(
+                generators, defaults, unit, make_engine<Engine>(seed, i + 1),
+                listeners[i])
+                .run();
+        });
+    }
+
+    return true;
+#else
+    static_cast<void>(generators);
+    static_cast<void>(defaults);
+    static_cast<void>(address);
+    static_cast<void>(threads);
+    static_cast<void>(seed);
+    static_cast<void>(unit);
+    static_cast<void>(ready);
+    return false;
+#endif
+}
+
+}  // namespace tpr
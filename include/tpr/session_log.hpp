@@ -0,0 +1,227 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "input.hpp"
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace tpr {
+
+// Session log layout, all integers in native byte order:
+//
+//   LogHeader | record...
+//   record = RecordHeader | SessionHeader | text | typed | LoggedKey...
+//
+// `RecordHeader::size` counts the bytes after the record header, so
+// readers can skip records of kinds they do not know.
+struct LogHeader {
+    static constexpr uint32_t signature = 0x314c5054;  // "TPL1"
+
+    uint32_t magic = signature;
+    uint32_t version = 1;
+};
+
+struct RecordHeader {
+    static constexpr uint32_t session = 1;
+
+    uint32_t size = 0;
+    uint32_t kind = session;
+};
+
+struct SessionHeader {
+    uint64_t seed = 0;
+    int64_t time = 0;  // nanoseconds since the unix epoch
+    uint32_t text_size = 0;
+    uint32_t typed_size = 0;
+    uint32_t keystrokes = 0;
+    uint32_t reserved = 0;
+};
+
+struct LoggedKey {
+    uint64_t time = 0;  // nanoseconds since the prompt was shown
+    uint8_t key = 0;
+    uint8_t reserved[7] = {};
+};
+
+static_assert(sizeof(LogHeader) == 8);
+static_assert(sizeof(RecordHeader) == 8);
+static_assert(sizeof(SessionHeader) == 32);
+static_assert(sizeof(LoggedKey) == 16);
+
+struct Session {
+    uint64_t seed = 0;
+    int64_t time = 0;
+    std::string_view text;
+    std::string_view typed;
+    const KeystrokeBuffer* keystrokes = nullptr;
+};
+
+// Append only log of typing sessions. Records are serialized into a
+// buffer allocated once and written in large chunks; the file is synced
+// to disk after every `sync_every` records and, if records were appended
+// since the last sync, when the log is closed. A `sync_every` of 0 never
+// syncs and leaves it to the OS.
+class SessionLog {
+   public:
+    static constexpr std::size_t default_capacity = 64 * 1024;
+
+    static auto open(const std::filesystem::path& path, uint32_t sync_every,
+                     std::size_t capacity = default_capacity)
+        -> std::optional<SessionLog> {
+        std::FILE* file = std::fopen(path.string().c_str(), "ab");
+
+        if (not file) {
+            return std::nullopt;
+        }
+
+        std::fseek(file, 0, SEEK_END);
+
+        SessionLog log(file, sync_every, capacity);
+
+        if (std::ftell(file) == 0) {
+            log.put(LogHeader{});
+
+            if (not log.flush()) {
+                return std::nullopt;
+            }
+        }
+
+        return log;
+    }
+
+    SessionLog(const SessionLog&) = delete;
+    auto operator=(const SessionLog&) -> SessionLog& = delete;
+
+    SessionLog(SessionLog&& other) noexcept
+        : file_(std::exchange(other.file_, nullptr)),
+          sync_every_(other.sync_every_),
+          unsynced_(other.unsynced_),
+          buffer_(std::move(other.buffer_)) {}
+
+    auto operator=(SessionLog&&) -> SessionLog& = delete;
+
+    ~SessionLog() {
+        if (not file_) {
+            return;
+        }
+
+        if (flush() and sync_every_ and unsynced_) {
+            sync();
+        }
+
+        std::fclose(file_);
+    }
+
+    auto append(const Session& session) -> bool {
+        const auto keys =
+            session.keystrokes ? session.keystrokes->size() : std::size_t{0};
+
+        const RecordHeader record{
+            .size = static_cast<uint32_t>(
+                sizeof(SessionHeader) + session.text.size() +
+                session.typed.size() + keys * sizeof(LoggedKey)),
+        };
+
+        const auto size = sizeof(record) + record.size;
+
+        if (buffer_.size() + size > buffer_.capacity() and not flush()) {
+            return false;
+        }
+
+        put(record);
+        put(SessionHeader{
+            .seed = session.seed,
+            .time = session.time,
+            .text_size = static_cast<uint32_t>(session.text.size()),
+            .typed_size = static_cast<uint32_t>(session.typed.size()),
+            .keystrokes = static_cast<uint32_t>(keys),
+        });
+        put_bytes(session.text.data(), session.text.size());
+        put_bytes(session.typed.data(), session.typed.size());
+
+        for (std::size_t i = 0; i < keys; ++i) {
+            const auto& keystroke = (*session.keystrokes)[i];
+
+            LoggedKey key;
+            key.time = keystroke.time;
+            key.key = static_cast<uint8_t>(keystroke.key);
+            put(key);
+        }
+
+        if (sync_every_ and ++unsynced_ >= sync_every_) {
+            return flush() and sync();
+        }
+
+        return true;
+    }
+
+    // Writes buffered records to the file without syncing it.
+    auto flush() -> bool {
+        const bool written =
+            std::fwrite(buffer_.data(), 1, buffer_.size(), file_) ==
+                buffer_.size() and
+            std::fflush(file_) == 0;
+
+        buffer_.clear();
+        return written;
+    }
+
+    auto sync() -> bool {
+        unsynced_ = 0;
+
+#if defined(_WIN32)
+        return _commit(_fileno(file_)) == 0;
+#else
+        return ::fsync(::fileno(file_)) == 0;
+#endif
+    }
+
+   private:
+    SessionLog(std::FILE* file, uint32_t sync_every, std::size_t capacity)
+        : file_(file), sync_every_(sync_every) {
+        buffer_.reserve(capacity);
+    }
+
+    template <class Record>
+    auto put(const Record& record) -> void {
+        put_bytes(&record, sizeof(record));
+    }
+
+    // grows the buffer only for records larger than its capacity
+    auto put_bytes(const void* data, std::size_t size) -> void {
+        const auto* bytes = static_cast<const std::byte*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+    }
+
+    std::FILE* file_ = nullptr;
+    uint32_t sync_every_ = 0;
+    uint32_t unsynced_ = 0;
+    std::vector<std::byte> buffer_;
+};
+
+// Nanoseconds since the unix epoch, the `Session::time` of a session
+// starting now.
+inline auto session_time() -> int64_t {
+    namespace chr = std::chrono;
+
+    return chr::duration_cast<chr::nanoseconds>(
+               chr::system_clock::now().time_since_epoch())
+        .count();
+}
+
+}  // namespace tpr
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace tpr {
+
+// Latest version of an immutable value shared with reader threads, in
+// the style of RCU: every reader keeps its own reference and refreshes it
+// between requests, its quiescent state, so a request never waits and
+// sees one complete version from start to end. A replaced version is
+// freed by whichever reader lets go of it last.
+//
+// Readers only look at the version counter on their fast path. Publishing
+// and picking up a new version swap the reference under a mutex, which is
+// held for a pointer copy and taken once per reader per publish.
+template <class T>
+class SnapshotSlot {
+   public:
+    explicit SnapshotSlot(std::shared_ptr<const T> value) noexcept
+        : value_(std::move(value)) {}
+
+    auto publish(std::shared_ptr<const T> value) -> void {
+        std::shared_ptr<const T> replaced;
+
+        {
+            const std::scoped_lock lock(mutex_);
+            replaced = std::exchange(value_, std::move(value));
+        }
+
+        version_.fetch_add(1, std::memory_order_release);
+
+        // `replaced` is released outside the lock, usually not the last
+        // reference since readers still hold it
+    }
+
+    [[nodiscard]] auto version() const noexcept -> uint64_t {
+        return version_.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] auto load() const -> std::shared_ptr<const T> {
+        const std::scoped_lock lock(mutex_);
+        return value_;
+    }
+
+   private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<const T> value_;
+    std::atomic<uint64_t> version_ = 0;
+};
+
+// One reader thread's reference into a SnapshotSlot.
+template <class T>
+class SnapshotReader {
+   public:
+    explicit SnapshotReader(const SnapshotSlot<T>& slot)
+        : slot_(slot), version_(slot.version()), value_(slot.load()) {}
+
+    // The newest version, picked up only if one was published since the
+    // last call. The result stays valid until the next call.
+    auto refresh() -> const T& {
+        if (const auto version = slot_.version(); version != version_) {
+            value_ = slot_.load();
+            version_ = version;
+        }
+
+        return *value_;
+    }
+
+   private:
+    const SnapshotSlot<T>& slot_;
+    uint64_t version_;
+    std::shared_ptr<const T> value_;
+};
+
+// How often a FileWatcher looks at the modification time.
+inline constexpr std::chrono::milliseconds reload_check_interval{1000};
+
+// Calls `changed()` on a background thread after the modification time of
+// `path` changed. A file still being written keeps changing, so the call
+// waits until the time held still for one interval. Files should still be
+// replaced by renaming over them: words of a mapped dictionary are views
+// into the old file, writing into it in place changes them under readers.
+class FileWatcher {
+   public:
+    FileWatcher(std::filesystem::path path, std::function<void()> changed,
+                std::chrono::milliseconds interval = reload_check_interval)
+        : thread_([path = std::move(path), changed = std::move(changed),
+                   interval, this](std::stop_token stop) {
+              watch(stop, path, changed, interval);
+          }) {}
+
+    FileWatcher(const FileWatcher&) = delete;
+    auto operator=(const FileWatcher&) -> FileWatcher& = delete;
+
+    ~FileWatcher() {
+        thread_.request_stop();
+        wakeup_.notify_all();
+    }
+
+   private:
+    auto watch(const std::stop_token& stop, const std::filesystem::path& path,
+               const std::function<void()>& changed,
+               std::chrono::milliseconds interval) -> void {
+        const auto modified = [&path] {
+            std::error_code error;
+            return std::filesystem::last_write_time(path, error);
+        };
+
+        auto loaded = modified();
+        auto seen = loaded;
+
+        std::unique_lock lock(mutex_);
+
+        const auto stopped = [&stop] { return stop.stop_requested(); };
+
+        while (not wakeup_.wait_for(lock, stop, interval, stopped)) {
+            const auto now = modified();
+
+            if (now != loaded and now == seen) {
+                lock.unlock();
+                changed();
+                lock.lock();
+
+                loaded = now;
+            }
+
+            seen = now;
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable_any wakeup_;
+    std::jthread thread_;  // last, it uses the members above
+};
+
+}  // namespace tpr
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "encoding.hpp"
+#include "generator.hpp"
+#include "profile.hpp"
+#include "random.hpp"
+
+namespace tpr {
+
+// Bytes read from a stream at once, lines longer than this grow the buffer.
+inline constexpr std::size_t stream_chunk_size = 64 * 1024;
+
+namespace detail {
+
+// Calls `visit(line)` for every line of `file` without its line break
+// until it returns false. Only the current chunk and an unfinished line
+// are held in memory. Returns false on a read error.
+template <class T, class Visit>
+auto for_each_line(std::FILE* file, Visit&& visit) -> bool {
+    using string_view = std::basic_string_view<T>;
+
+    std::vector<T> buffer(stream_chunk_size);
+    std::size_t kept = 0;
+
+    const auto trimmed = [](string_view line) {
+        return line.ends_with(T('\r')) ? line.substr(0, line.size() - 1)
+                                       : line;
+    };
+
+    for (;;) {
+        if (kept == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        const auto read = std::fread(buffer.data() + kept, sizeof(T),
+                                     buffer.size() - kept, file);
+
+        string_view rest(buffer.data(), kept + read);
+
+        for (auto newline = rest.find(T('\n')); newline != string_view::npos;
+             newline = rest.find(T('\n'))) {
+            if (not visit(trimmed(rest.substr(0, newline)))) {
+                return true;
+            }
+
+            rest.remove_prefix(newline + 1);
+        }
+
+        if (read == 0) {
+            if (not rest.empty()) {
+                visit(trimmed(rest));
+            }
+
+            return not std::ferror(file);
+        }
+
+        std::copy(rest.begin(), rest.end(), buffer.begin());
+        kept = rest.size();
+    }
+}
+
+}  // namespace detail
+
+// Reads a newline separated dictionary from a pipe or any other stream
+// that can not be mapped.
+//
+// With a `config.top` only the first `top` words can ever be drawn, so
+// reading stops after them and memory is O(top). Without it every word
+// is a candidate and the stream may be unbounded: a reservoir sample
+// (Vitter's algorithm R) keeps `config.amount` uniformly chosen words
+// passing the length limits, memory is O(amount). Kept words stay in
+// stream order, so frequency order is preserved either way.
+template <class T>
+auto read_dictionary_stream(std::FILE* file, const TestConfig& config,
+                            uint64_t seed,
+                            const std::pmr::polymorphic_allocator<T>& allocator)
+    -> std::optional<Dictionary<T>> {
+    using string_view = std::basic_string_view<T>;
+
+    TPR_PROFILE_SCOPE(dictionary_parse);
+
+    typename Dictionary<T>::text_container text(allocator);
+    typename Dictionary<T>::offsets_container offsets(allocator);
+    typename Dictionary<T>::lengths_container lengths(allocator);
+
+    const auto fits = [](string_view word) {
+        return word.size() <= max_word_length;
+    };
+
+    if (config.top) {
+        offsets.reserve(config.top);
+        lengths.reserve(config.top);
+
+        const bool read = detail::for_each_line<T>(file, [&](string_view word) {
+            if (fits(word)) {
+                offsets.push_back(static_cast<uint32_t>(text.size()));
+                lengths.push_back(static_cast<uint8_t>(word.size()));
+                text.insert(text.end(), word.begin(), word.end());
+            }
+
+            return offsets.size() < config.top;
+        });
+
+        if (not read) {
+            return std::nullopt;
+        }
+
+        return std::make_optional<Dictionary<T>>(
+            std::move(text), std::move(offsets), std::move(lengths));
+    }
+
+    // the encoding is not known before the end, so bounds are checked in
+    // code points, which are bytes for ASCII words
+    const auto matches = [&config, &fits](string_view word) {
+        const auto length = encoding_traits<Utf8>::length(word);
+
+        return fits(word) and length >= config.min_length and
+               (not config.max_length or length <= config.max_length);
+    };
+
+    struct Slot {
+        uint64_t line;
+        std::pmr::basic_string<T> word;
+    };
+
+    std::pmr::vector<Slot> reservoir(allocator);
+    reservoir.reserve(config.amount);
+
+    auto engine = make_engine<Xoshiro256>(seed, 1);
+    uint64_t line = 0;
+    uint64_t seen = 0;
+
+    const bool read = detail::for_each_line<T>(file, [&](string_view word) {
+        if (matches(word)) {
+            if (reservoir.size() < config.amount) {
+                reservoir.push_back(
+                    Slot{line, std::pmr::basic_string<T>(word, allocator)});
+            } else if (const auto slot =
+                           std::uniform_int_distribution<uint64_t>(0, seen)(
+                               engine);
+                       slot < config.amount) {
+                reservoir[slot].line = line;
+                reservoir[slot].word.assign(word);
+            }
+
+            ++seen;
+        }
+
+        ++line;
+        return true;
+    });
+
+    if (not read) {
+        return std::nullopt;
+    }
+
+    std::ranges::sort(reservoir, {}, &Slot::line);
+
+    std::size_t size = 0;
+
+    for (const auto& slot : reservoir) {
+        size += slot.word.size();
+    }
+
+    text.reserve(size);
+    offsets.reserve(reservoir.size());
+    lengths.reserve(reservoir.size());
+
+    for (const auto& slot : reservoir) {
+        offsets.push_back(static_cast<uint32_t>(text.size()));
+        lengths.push_back(static_cast<uint8_t>(slot.word.size()));
+        text.insert(text.end(), slot.word.begin(), slot.word.end());
+    }
+
+    return std::make_optional<Dictionary<T>>(
+        std::move(text), std::move(offsets), std::move(lengths));
+}
+
+}  // namespace tpr
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <optional>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace tpr {
+
+// Puts the terminal into unbuffered, non echoing mode for as long as the
+// object lives, so every key press can be read as soon as it happens.
+class RawTerminal {
+   public:
+    RawTerminal() noexcept {
+#if defined(_WIN32)
+        input_ = GetStdHandle(STD_INPUT_HANDLE);
+        output_ = GetStdHandle(STD_OUTPUT_HANDLE);
+
+        if (not GetConsoleMode(input_, &input_mode_)) {
+            return;
+        }
+
+        GetConsoleMode(output_, &output_mode_);
+
+        SetConsoleMode(input_,
+                       (input_mode_ & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT |
+                                        ENABLE_PROCESSED_INPUT)) |
+                           ENABLE_VIRTUAL_TERMINAL_INPUT);
+        SetConsoleMode(output_,
+                       output_mode_ | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#else
+        if (not ::isatty(STDIN_FILENO) or
+            ::tcgetattr(STDIN_FILENO, &original_) != 0) {
+            return;
+        }
+
+        termios raw = original_;
+        raw.c_iflag &= ~(IXON | ICRNL);
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+
+        if (::tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+            return;
+        }
+#endif
+        active_ = true;
+    }
+
+    RawTerminal(const RawTerminal&) = delete;
+    auto operator=(const RawTerminal&) -> RawTerminal& = delete;
+
+    ~RawTerminal() {
+        if (not active_) {
+            return;
+        }
+
+#if defined(_WIN32)
+        SetConsoleMode(input_, input_mode_);
+        SetConsoleMode(output_, output_mode_);
+#else
+        ::tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_);
+#endif
+    }
+
+    // False if input is not an interactive terminal (e.g. piped).
+    [[nodiscard]] auto active() const noexcept { return active_; }
+
+    // Columns of the output terminal, 80 if it can not be queried.
+    [[nodiscard]] auto width() const noexcept -> std::size_t {
+#if defined(_WIN32)
+        CONSOLE_SCREEN_BUFFER_INFO info;
+
+        if (GetConsoleScreenBufferInfo(output_, &info)) {
+            return static_cast<std::size_t>(info.srWindow.Right -
+                                            info.srWindow.Left + 1);
+        }
+#else
+        winsize size{};
+
+        if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 and size.ws_col) {
+            return size.ws_col;
+        }
+#endif
+        return 80;
+    }
+
+    // Blocks until the next byte arrives, nullopt on end of input.
+    auto read() const noexcept -> std::optional<char> {
+        char key;
+
+#if defined(_WIN32)
+        DWORD read = 0;
+
+        if (not ReadFile(input_, &key, 1, &read, nullptr) or read != 1) {
+            return std::nullopt;
+        }
+#else
+        if (::read(STDIN_FILENO, &key, 1) != 1) {
+            return std::nullopt;
+        }
+#endif
+
+        return key;
+    }
+
+    // The next byte if one arrives within `timeout`, nullopt otherwise or
+    // on end of input.
+    auto read(std::chrono::milliseconds timeout) const noexcept
+        -> std::optional<char> {
+        const auto milliseconds = static_cast<int>(timeout.count());
+
+#if defined(_WIN32)
+        if (WaitForSingleObject(input_, static_cast<DWORD>(milliseconds)) !=
+            WAIT_OBJECT_0) {
+            return std::nullopt;
+        }
+#else
+        pollfd input{.fd = STDIN_FILENO, .events = POLLIN, .revents = 0};
+
+        if (::poll(&input, 1, milliseconds) != 1) {
+            return std::nullopt;
+        }
+#endif
+
+        return read();
+    }
+
+   private:
+#if defined(_WIN32)
+    HANDLE input_ = nullptr;
+    HANDLE output_ = nullptr;
+    DWORD input_mode_ = 0;
+    DWORD output_mode_ = 0;
+#else
+    termios original_{};
+#endif
+    bool active_ = false;
+};
+
+// Points stdin back at the controlling terminal once it was used up by a
+// pipe, e.g. words piped in before the test is typed. Returns false if
+// there is no terminal.
+inline auto reopen_terminal_input() noexcept -> bool {
+#if defined(_WIN32)
+    return std::freopen("CONIN$", "r", stdin) != nullptr;
+#else
+    return std::freopen("/dev/tty", "r", stdin) != nullptr;
+#endif
+}
+
+}  // namespace tpr
@@ -7,62 +7,669 @@
 #include <argparse/argparse.hpp>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <exception>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <memory_resource>
+#include <new>
 #include <optional>
 #include <random>
-#include <range/v3/range.hpp>
-#include <range/v3/view.hpp>
 #include <ranges>
 #include <ratio>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tpr/adaptive.hpp>
+#include <tpr/alignment.hpp>
+#include <tpr/arena.hpp>
+#include <tpr/batch.hpp>
+#include <tpr/dictionary.hpp>
+#include <tpr/encoding.hpp>
+#include <tpr/export.hpp>
+#include <tpr/generator.hpp>
+#include <tpr/index_cache.hpp>
+#include <tpr/input.hpp>
+#include <tpr/latency.hpp>
+#include <tpr/live.hpp>
+#include <tpr/markov.hpp>
+#include <tpr/mix.hpp>
+#include <tpr/profile.hpp>
+#include <tpr/random.hpp>
+#include <tpr/render.hpp>
+#include <tpr/replay.hpp>
+#include <tpr/serve.hpp>
+#include <tpr/session_log.hpp>
+#include <tpr/snapshot.hpp>
+#include <tpr/stream.hpp>
+#include <type_traits>
 #include <vector>
 
 namespace tpr {
 
-template <class T>
-auto read_dictionary(const std::filesystem::path& path, uint64_t words,
-                     const std::pmr::polymorphic_allocator<T>& allocator)
-    -> std::optional<std::pmr::vector<std::pmr::basic_string<T>>> {
-    using fstream = std::basic_fstream<T>;
-    using string = std::pmr::basic_string<T>;
-    using vector = std::pmr::vector<string>;
+// Command line options of an interactive test.
+struct TestOptions {
+    std::string unit;
+    bool live = false;
+    uint64_t seed = 0;
+    std::optional<std::string> record;
+    uint32_t sync_every = 0;
+    std::optional<std::string> adaptive;
+    std::optional<std::string> export_path;
+    ExportFormat export_format = ExportFormat::jsonl;
+    unsigned threads = 1;
+    const IndexCache* cache = nullptr;
+};
 
-    fstream stream(path, std::ios::in);
+// Test biased toward the slow bigrams of the sessions in the
+// `options.adaptive` log, a log that does not exist yet has no bias.
+// The latencies folded by the last run are kept in the index cache with
+// the log offset they reach, so only sessions appended since are folded
+// and only the bigrams typed in them are updated in the sampler.
+// Nullopt if the log can not be read.
+template <class Char, class Engine>
+auto generate_adaptive(TestGenerator<Char, Engine>& generator,
+                       const TestConfig& config, const TestOptions& options,
+                       std::pmr::memory_resource* resource)
+    -> std::optional<std::pmr::basic_string<Char>> {
+    const auto& dictionary = generator.dictionary();
 
-    if (!stream) {
+    std::optional<MappedFile> log;
+    LatencyCheckpoint checkpoint{.latencies = KeyLatencies(resource)};
+    std::optional<KeyLatencies> appended(std::in_place, resource);
+    std::size_t offset = 0;
+
+    if (std::filesystem::exists(*options.adaptive)) {
+        log = MappedFile::open(*options.adaptive);
+
+        if (not log) {
+            return std::nullopt;
+        }
+
+        checkpoint = read_latency_checkpoint(options.cache, dictionary.size(),
+                                             *log, resource);
+
+        LogReader reader(log->bytes(), checkpoint.offset);
+        appended = collect_latencies(reader, options.threads);
+        offset = reader.offset();
+    }
+
+    if (not appended) {
         return std::nullopt;
     }
 
-    vector dictionary(allocator);
-    dictionary.reserve(words);
+    const auto index = cached_bigram_index(options.cache, dictionary, resource);
+    const auto candidates = generator.index().query(
+        config.min_length, config.max_length, config.top);
+
+    AdaptiveSampler sampler(candidates, index, dictionary.size(),
+                            config.weighted, checkpoint.latencies, resource);
+
+    checkpoint.latencies.merge(*appended);
+    sampler.update(checkpoint.latencies, appended->bigrams());
 
-    for (string buffer(allocator); std::getline(stream, buffer);) {
-        dictionary.emplace_back(std::move(buffer));
+    if (log and offset != checkpoint.offset) {
+        write_latency_checkpoint(options.cache, dictionary.size(), *log,
+                                 checkpoint.latencies, offset);
     }
 
-    return dictionary;
+    return generate_adaptive_test(dictionary, sampler, config.amount,
+                                  generator.engine(), resource);
 }
 
-auto report_error(const auto& lhs, const auto& rhs) {
-    if (lhs != rhs) {
-        fmt::print(fg(fmt::terminal_color::red), "{}", rhs);
-        return true;
+// Test typed next, nullopt if the --adaptive log can not be read.
+template <class Char, class Engine>
+auto next_test(TestGenerator<Char, Engine>& generator, const TestConfig& config,
+               const TestOptions& options, std::pmr::memory_resource* resource)
+    -> std::optional<std::pmr::basic_string<Char>> {
+    if (not options.adaptive) {
+        return generator.generate(config, generator.engine(), resource);
+    }
+
+    return generate_adaptive(generator, config, options, resource);
+}
+
+// Mixed and Markov tests are not adaptive, --adaptive is refused before
+// one is generated.
+template <class Generator>
+auto next_test(Generator& generator, const TestConfig& config,
+               const TestOptions& /* options */,
+               std::pmr::memory_resource* resource)
+    -> std::optional<typename Generator::string> {
+    return generator.generate(config, generator.engine(), resource);
+}
+
+// Characters are scored and counted as those of `Encoding`.
+template <class Encoding, class Generator>
+auto run_test(Generator& generator, const TestConfig& config,
+              const TestOptions& options) -> int {
+    namespace chr = std::chrono;
+
+    using Char = typename Generator::char_type;
+
+    // the test, the typed text and their alignment, freed with it
+    ThreadArena arena(scoring_arena_size);
+    auto* const resource = arena.resource();
+
+    std::pmr::basic_string<Char> filtered(resource);
+
+    if (auto test = next_test(generator, config, options, resource)) {
+        filtered = std::move(*test);
+    } else {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not read session log \"{}\"\n",
+                   *options.adaptive);
+        return 1;
+    }
+
+    if (filtered.empty()) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "no words match the length limits\n");
+        return 1;
+    }
+
+    std::pmr::basic_string<Char> buffer(resource);
+    buffer.reserve(filtered.size());
+
+    // room for every character, a correction of each and the enter key
+    KeystrokeBuffer keystrokes(filtered.size() * 2 + 1, resource);
+
+    chr::nanoseconds duration;
+
+    const auto started = session_time();
+
+    if (const RawTerminal terminal; terminal.active() and options.live) {
+        LiveEcho<Char, Encoding> echo(filtered, terminal.width(), resource);
+        echo.begin();
+        TPR_PROFILE_PROMPT();
+
+        const bool typed = capture_input<Encoding>(terminal, keystrokes, buffer, echo);
+        echo.finish();
+
+        if (not typed) {
+            return 1;
+        }
+
+        duration = typing_duration(keystrokes);
+    } else if (terminal.active()) {
+        fmt::print("{}\n", filtered);
+        std::fflush(stdout);
+        TPR_PROFILE_PROMPT();
+
+        if (not capture_input<Encoding>(terminal, keystrokes, buffer)) {
+            return 1;
+        }
+
+        duration = typing_duration(keystrokes);
     } else {
-        fmt::print("{}", rhs);
-        return false;
+        fmt::print("{}\n", filtered);
+        std::fflush(stdout);
+        TPR_PROFILE_PROMPT();
+
+        TPR_PROFILE_SCOPE(input);
+
+        const auto start_time = chr::steady_clock::now();
+        std::getline(std::cin, buffer);
+        duration = chr::steady_clock::now() - start_time;
+    }
+
+    fmt::basic_memory_buffer<Char> out;
+    out.push_back(Char('\n'));
+
+    const Score result = [&] {
+        TPR_PROFILE_SCOPE(scoring);
+
+        return Score{
+            .characters = render_errors<Char, Encoding>(filtered, buffer,
+                                                        out, resource),
+            .words = align(split_words<Char>(filtered, resource),
+                           split_words<Char>(buffer, resource), resource),
+        };
+    }();
+
+    fmt::format_to(std::back_inserter(out),
+                   "\nErrors: {} ({} wrong, {} extra, {} missed), "
+                   "wrong words: {}\n",
+                   result.characters.total(), result.characters.substitutions,
+                   result.characters.insertions, result.characters.deletions,
+                   result.words.total());
+
+    fmt::format_to(std::back_inserter(out), fg(fmt::terminal_color::yellow),
+                   "You were typing: {:.2f} {} in {:%S}s\n",
+                   typing_speed(encoding_traits<Encoding>::length(
+                                    std::basic_string_view<Char>(buffer)),
+                                duration, options.unit),
+                   options.unit,
+                   chr::duration_cast<chr::milliseconds>(duration));
+
+    if (not flush(out, stdout)) {
+        return 1;
+    }
+
+    if (options.record) {
+        auto log = SessionLog::open(*options.record, options.sync_every);
+
+        const bool recorded = log and log->append({
+                                          .seed = options.seed,
+                                          .time = started,
+                                          .text = filtered,
+                                          .typed = buffer,
+                                          .keystrokes = &keystrokes,
+                                      });
+
+        if (not recorded) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not record session to \"{}\"\n",
+                       *options.record);
+            return 1;
+        }
+    }
+
+    if (options.export_path) {
+        std::pmr::vector<uint64_t> words(resource);
+        word_times(keystrokes, keystrokes.size(), words);
+
+        const bool exported = export_result(
+            *options.export_path,
+            {
+                .seed = options.seed,
+                .time = started,
+                .characters = encoding_traits<Encoding>::length(
+                    std::basic_string_view<Char>(buffer)),
+                .duration = duration,
+                .score = result,
+                .words = words,
+            },
+            options.export_format);
+
+        if (not exported) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not export result to \"{}\"\n",
+                       *options.export_path);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+template <class Generator>
+auto run_batch(const Generator& generator, const TestConfig& config,
+               uint64_t count, unsigned threads, uint64_t seed,
+               const std::string& output_path) -> int {
+    const bool to_stdout = output_path == "-";
+
+    std::FILE* output =
+        to_stdout ? stdout : std::fopen(output_path.c_str(), "wb");
+
+    if (not output) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not open file \"{}\"\n", output_path);
+        return 1;
+    }
+
+    const bool written =
+        generate_batch(generator, config, count, threads, seed, output);
+
+    if (not to_stdout) {
+        std::fclose(output);
+    }
+
+    if (not written) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not write file \"{}\"\n",
+                   output_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Generator over the dictionary at `path` as it is now, null if it can not
+// be read. It is built beside the serving threads and freed by whichever
+// of them lets go of it last, so its memory comes from the thread safe
+// default resource.
+template <class Char, class Engine>
+auto load_generator(const std::filesystem::path& path,
+                    const std::filesystem::path& cache_directory,
+                    const TestOptions& options)
+    -> std::shared_ptr<const TestGenerator<Char, Engine>> {
+    auto* resource = std::pmr::get_default_resource();
+
+    auto dictionary = read_dictionary<Char>(path, resource, options.threads);
+
+    if (not dictionary) {
+        return nullptr;
+    }
+
+    const auto cache =
+        IndexCache::open(cache_directory, path, dictionary->file());
+    const auto* indices = cache ? &*cache : nullptr;
+
+    const bool ascii = is_ascii(dictionary->text());
+
+    auto index = ascii ? cached_length_index<Ascii>(indices, *dictionary,
+                                                    resource)
+                       : cached_length_index<Utf8>(indices, *dictionary,
+                                                   resource);
+
+    return std::make_shared<const TestGenerator<Char, Engine>>(
+        std::move(*dictionary), std::move(index), options.seed, resource);
+}
+
+// Serves tests until the process is killed. With a `watched` file the
+// dictionary is reloaded from it in the background whenever it changes and
+// published to the serving threads once its index is built.
+template <class Char, class Engine>
+auto run_serve(TestGenerator<Char, Engine> generator, const TestConfig& config,
+               const ServeAddress& address, const TestOptions& options,
+               const std::optional<std::filesystem::path>& watched,
+               const std::filesystem::path& cache_directory) -> int {
+    const auto host = address.host.empty() ? "*" : address.host;
+
+    SnapshotSlot<TestGenerator<Char, Engine>> generators(
+        std::make_shared<const TestGenerator<Char, Engine>>(
+            std::move(generator)));
+
+    std::optional<FileWatcher> watcher;
+
+    if (watched) {
+        watcher.emplace(*watched, [&] {
+            auto next = load_generator<Char, Engine>(
+                *watched, cache_directory, options);
+
+            if (not next) {
+                fmt::print(fg(fmt::terminal_color::yellow),
+                           "Could not reload \"{}\", still serving the "
+                           "previous dictionary\n",
+                           watched->string());
+                return;
+            }
+
+            const auto words = next->dictionary().size();
+            generators.publish(std::move(next));
+
+            fmt::print("Reloaded \"{}\" with {} words\n", watched->string(),
+                       words);
+            std::fflush(stdout);
+        });
+    }
+
+    const bool served = serve(
+        generators, config, address, options.threads, options.seed,
+        options.unit, [&](uint16_t port) {
+            fmt::print("Serving tests on {}:{} with {} threads\n", host, port,
+                       options.threads);
+            std::fflush(stdout);
+        });
+
+    if (not served) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not serve on \"{}:{}\"\n", host,
+                   address.port);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Test, or --batch of tests, drawing words from every source in proportion
+// to its weight. Dictionaries and their indices are loaded once, all into
+// `resource`.
+template <class Char>
+auto run_mixed(std::span<const MixSource> sources, std::string_view engine,
+               const TestConfig& config, std::optional<uint64_t> batch,
+               const std::string& output_path,
+               const std::filesystem::path& cache_directory,
+               const TestOptions& options, std::pmr::memory_resource* resource)
+    -> int {
+    std::pmr::vector<MixedDictionary<Char>> loaded(resource);
+    loaded.reserve(sources.size());
+
+    // tests are scored as ASCII only if every source is
+    bool ascii = true;
+
+    for (const auto& source : sources) {
+        auto dictionary =
+            read_dictionary<Char>(source.path, resource, options.threads);
+
+        if (not dictionary) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not read file \"{}\"\n",
+                       source.path);
+            return 1;
+        }
+
+        const auto cache =
+            IndexCache::open(cache_directory, source.path, dictionary->file());
+        const auto* indices = cache ? &*cache : nullptr;
+
+        const bool source_ascii = is_ascii(dictionary->text());
+        ascii = ascii and source_ascii;
+
+        auto index = source_ascii ? cached_length_index<Ascii>(
+                                        indices, *dictionary, resource)
+                                  : cached_length_index<Utf8>(
+                                        indices, *dictionary, resource);
+
+        loaded.push_back({std::move(*dictionary), std::move(index),
+                          source.weight});
+    }
+
+    return with_engine(engine, [&]<class Engine>(std::type_identity<Engine>) {
+        MixedGenerator<Char, Engine> generator(std::move(loaded), options.seed,
+                                               resource);
+
+        if (batch) {
+            return run_batch(generator, config, *batch, options.threads,
+                             options.seed, output_path);
+        }
+
+        return ascii ? run_test<Ascii>(generator, config, options)
+                     : run_test<Utf8>(generator, config, options);
+    });
+}
+
+// Test, or --batch of tests, following the Markov model at `model_path`,
+// built from it if it is a corpus rather than a compiled model.
+template <class Char, class Engine>
+auto run_markov(Dictionary<Char> dictionary, bool ascii,
+                const std::filesystem::path& model_path,
+                const TestConfig& config, std::optional<uint64_t> batch,
+                const std::string& output_path, const TestOptions& options,
+                std::pmr::memory_resource* resource) -> int {
+    auto model = read_markov_model(model_path, dictionary, resource);
+
+    if (not model) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not read Markov model \"{}\" of "
+                   "this dictionary\n",
+                   model_path.string());
+        return 1;
+    }
+
+    MarkovGenerator<Char, Engine> generator(
+        std::move(dictionary), std::move(*model), options.seed, resource);
+
+    if (batch) {
+        return run_batch(generator, config, *batch, options.threads,
+                         options.seed, output_path);
+    }
+
+    return ascii ? run_test<Ascii>(generator, config, options)
+                 : run_test<Utf8>(generator, config, options);
+}
+
+inline auto run_replay(const std::string& path, unsigned threads) -> int {
+    const auto log = MappedFile::open(path);
+
+    if (not log) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not read file \"{}\"\n", path);
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto stats = replay_sessions(*log, threads);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (not stats) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: \"{}\" is not a session log\n", path);
+        return 1;
+    }
+
+    fmt::memory_buffer out;
+    render_replay(*stats, elapsed, out);
+
+    return flush(out, stdout) ? 0 : 1;
+}
+
+// Exports the result of every session of the log at `path` to
+// `export_path`, '-' for stdout, and prints the throughput.
+inline auto run_export(const std::string& path, unsigned threads,
+                       const std::string& export_path, ExportFormat format)
+    -> int {
+    const auto log = MappedFile::open(path);
+
+    if (not log) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not read file \"{}\"\n", path);
+        return 1;
+    }
+
+    const bool to_stdout = export_path == "-";
+
+    std::FILE* output =
+        to_stdout ? stdout : std::fopen(export_path.c_str(), "wb");
+
+    if (not output) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not open file \"{}\"\n",
+                   export_path);
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto summary = export_sessions(*log, threads, format, output);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const bool closed = to_stdout or std::fclose(output) == 0;
+
+    if (not summary) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: \"{}\" is not a session log\n", path);
+        return 1;
+    }
+
+    if (not summary->written or not closed) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not write file \"{}\"\n",
+                   export_path);
+        return 1;
+    }
+
+    if (to_stdout) {
+        return 0;
+    }
+
+    const auto seconds = std::chrono::duration<double>(elapsed).count();
+
+    fmt::print("Exported {} sessions in {:.3f}s ({:.0f} sessions/s, "
+               "{:.1f} MB/s){}\n",
+               summary->sessions, seconds,
+               seconds > 0.0 ? summary->sessions / seconds : 0.0,
+               seconds > 0.0 ? summary->bytes / seconds / 1e6 : 0.0,
+               summary->truncated ? ", log is truncated" : "");
+
+    return 0;
+}
+
+inline auto run_stats(const std::string& path, unsigned threads) -> int {
+    const auto log = MappedFile::open(path);
+
+    if (not log) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: Could not read file \"{}\"\n", path);
+        return 1;
+    }
+
+    const auto latencies = collect_latencies(*log, threads);
+
+    if (not latencies) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "Error occured: \"{}\" is not a session log\n", path);
+        return 1;
     }
+
+    fmt::memory_buffer out;
+    render_latencies(*latencies, 10, out);
+
+    return flush(out, stdout) ? 0 : 1;
 }
 
 }  // namespace tpr
 
+#if defined(TYPER_PROFILE)
+// Every heap allocation of a profiled build is counted toward the phase of
+// its thread. The array forms end up here too, the aligned ones are what
+// std::pmr::new_delete_resource allocates with.
+auto operator new(std::size_t size) -> void* {
+    tpr::profile().allocated(size);
+
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment) -> void* {
+    tpr::profile().allocated(size);
+
+    const auto align = static_cast<std::size_t>(alignment);
+    const auto rounded = (std::max<std::size_t>(size, 1) + align - 1) &
+                         ~(align - 1);
+
+#if defined(_WIN32)
+    void* pointer = _aligned_malloc(rounded, align);
+#else
+    void* pointer = std::aligned_alloc(align, rounded);
+#endif
+
+    if (pointer) {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+auto operator delete(void* pointer) noexcept -> void { std::free(pointer); }
+
+auto operator delete(void* pointer, std::size_t /* size */) noexcept -> void {
+    std::free(pointer);
+}
+
+auto operator delete(void* pointer, std::align_val_t /* alignment */) noexcept
+    -> void {
+#if defined(_WIN32)
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+auto operator delete(void* pointer, std::size_t /* size */,
+                     std::align_val_t alignment) noexcept -> void {
+    operator delete(pointer, alignment);
+}
+#endif
+
 int main(int argc, const char* argv[]) {
     using Char = char;
-    using String = std::pmr::basic_string<Char>;
-    using Strings = std::pmr::vector<String>;
 
     argparse::ArgumentParser program("typer", "0.0.1");
 
@@ -86,24 +693,137 @@ int main(int argc, const char* argv[]) {
     program.add_argument("--top", "-t")
         .help(
             "select n top words from your list (your file can contain 20k "
-            "words but you only want 200 most frequent to appear in test)")
+            "words but you only want 200 most frequent to appear in test), "
+            "'0' selects all words")
         .scan<'u', uint64_t>()
         .default_value(200ull);
 
     program.add_argument("--dictionary", "-d")
-        .help("path to dictionary file with newline separated words")
-        .default_value("res/20k.txt");
+        .help(
+            "path to dictionary file with newline separated words or "
+            "compiled .tpd file, '-' reads words from stdin. Given more than "
+            "once as path:weight, tests mix words of every dictionary in "
+            "proportion to its weight")
+        .default_value(std::vector<std::string>{"res/20k.txt"})
+        .append();
 
     program.add_argument("--dictionary-size", "-s")
-        .help("size of words in dictionary file can, used to read file faster")
-        .scan<'u', uint64_t>()
-        .default_value(20'000ull);
+        .help("deprecated and ignored, the word count is read from the file")
+        .scan<'u', uint64_t>();
 
     program.add_argument("--measure-units", "-m")
         .help("units of measure")
         .default_value("wpm")
         .choices("wpm", "cpm", "wps", "cps");
 
+    program.add_argument("--distribution", "-w")
+        .help(
+            "how words are drawn: 'uniform' picks distinct words, 'zipf' "
+            "draws words weighted by their frequency rank")
+        .default_value("uniform")
+        .choices("uniform", "zipf");
+
+    program.add_argument("--live")
+        .help("highlight mistakes over the test text while typing")
+        .flag();
+
+    program.add_argument("--record", "-r")
+        .help("append the typing session to this binary session log");
+
+    program.add_argument("--sync-every")
+        .help(
+            "sync the session log to disk after n records and when typer "
+            "exits with records not synced yet, '0' never syncs")
+        .scan<'u', uint32_t>()
+        .default_value(16u);
+
+    program.add_argument("--batch", "-b")
+        .help("generate n tests at once, one per line, without typing them")
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--output", "-o")
+        .help("file to write --batch tests to, '-' for stdout")
+        .default_value("-");
+
+    program.add_argument("--threads", "-j")
+        .help(
+            "number of threads generating --batch tests, scoring --replay, "
+            "answering --serve requests and parsing large dictionaries")
+        .scan<'u', unsigned>()
+        .default_value(std::max(std::thread::hardware_concurrency(), 1u));
+
+    program.add_argument("--seed")
+        .help("seed of the random engine, same seed generates same tests")
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--engine", "-e")
+        .help("random engine used to generate tests")
+        .default_value("xoshiro")
+        .choices("xoshiro", "pcg", "mt19937");
+
+    program.add_argument("--compile-dictionary")
+        .help(
+            "compile newline separated dictionary into binary .tpd file which "
+            "loads without parsing, usage: --compile-dictionary in.txt out.tpd")
+        .nargs(2);
+
+    program.add_argument("--markov")
+        .help(
+            "generate text following the word pairs and triples of a corpus "
+            "instead of unrelated words, a text file or a --compile-markov "
+            "model of the same --dictionary");
+
+    program.add_argument("--compile-markov")
+        .help(
+            "compile the Markov model of a corpus over the words of "
+            "--dictionary into a .tpm file which loads without building, "
+            "usage: --compile-markov corpus.txt out.tpm")
+        .nargs(2);
+
+    program.add_argument("--replay")
+        .help(
+            "re-score every session of a --record log and print aggregate "
+            "stats");
+
+    program.add_argument("--export")
+        .help(
+            "write every --replay session, or the result of the test, as one "
+            "line of --export-format to this file, '-' for stdout. Tests "
+            "append to it");
+
+    program.add_argument("--export-format")
+        .help("format of --export, json lines or csv with a header")
+        .default_value("jsonl")
+        .choices("jsonl", "csv");
+
+    program.add_argument("--adaptive")
+        .help(
+            "draw more words with the bigrams typed slowest in this --record "
+            "log");
+
+    program.add_argument("--cache-dir")
+        .help(
+            "directory caching indices derived from dictionaries, '' to "
+            "always rebuild them")
+        .default_value(tpr::default_cache_directory().string());
+
+    program.add_argument("--stats")
+        .help(
+            "print key and bigram latency percentiles and the slowest ones "
+            "from a --record log");
+
+    program.add_argument("--serve")
+        .help(
+            "keep the dictionary loaded and serve tests over http on "
+            "[host]:port, GET /generate and POST /score. The dictionary is "
+            "reloaded when its file is replaced");
+
+    program.add_argument("--profile")
+        .help(
+            "print the time spent loading, generating, typing and scoring to "
+            "stderr, needs a build with TYPER_PROFILE")
+        .flag();
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::exception& err) {
@@ -112,7 +832,67 @@ int main(int argc, const char* argv[]) {
         return 1;
     }
 
-    std::pmr::unsynchronized_pool_resource resource;
+    const bool profiled = program.get<bool>("--profile");
+
+    if (profiled) {
+#if defined(TYPER_PROFILE)
+        tpr::profile().enable();
+#else
+        fmt::print(fg(fmt::terminal_color::yellow),
+                   "--profile is ignored, typer was built without "
+                   "TYPER_PROFILE\n");
+#endif
+    }
+
+    // Dictionaries, their indices and models, allocated once on this thread
+    // and then only read, by worker threads too. Threads allocate for their
+    // tests from a tpr::ThreadArena of their own, never from here.
+    std::pmr::monotonic_buffer_resource resource;
+
+    if (const auto paths =
+            program.present<std::vector<std::string>>("--compile-dictionary")) {
+        const std::filesystem::path input((*paths)[0]);
+        const std::filesystem::path output((*paths)[1]);
+
+        const auto compiled =
+            tpr::read_dictionary<Char>(input, &resource)
+                .transform([&output](const auto& dictionary) {
+                    return tpr::compile_dictionary(dictionary, output);
+                });
+
+        if (not compiled) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not read file \"{}\"\n",
+                       input.string());
+            return 1;
+        }
+
+        if (not *compiled) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not write file \"{}\"\n",
+                       output.string());
+            return 1;
+        }
+
+        return 0;
+    }
+
+    const auto export_path = program.present("--export");
+    const auto export_format =
+        tpr::export_format(program.get("--export-format"));
+
+    if (const auto path = program.present("--replay")) {
+        if (export_path) {
+            return tpr::run_export(*path, program.get<unsigned>("--threads"),
+                                   *export_path, export_format);
+        }
+
+        return tpr::run_replay(*path, program.get<unsigned>("--threads"));
+    }
+
+    if (const auto path = program.present("--stats")) {
+        return tpr::run_stats(*path, program.get<unsigned>("--threads"));
+    }
 
     const uint64_t amount = program.get<uint64_t>("--amount");
 
@@ -124,12 +904,6 @@ int main(int argc, const char* argv[]) {
 
     const uint64_t top = program.get<uint64_t>("--top");
 
-    if (not amount) {
-        fmt::print(fg(fmt::terminal_color::red),
-                   "--top = 0 no words selected for test\n");
-        return 1;
-    }
-
     const uint64_t min_length = program.get<uint64_t>("--min-length");
     const uint64_t max_length = program.get<uint64_t>("--max-length");
 
@@ -139,79 +913,260 @@ int main(int argc, const char* argv[]) {
         return 1;
     }
 
-    const uint64_t dictionary_size = program.get<uint64_t>("-s");
+    if (program.present<uint64_t>("--dictionary-size")) {
+        fmt::print(fg(fmt::terminal_color::yellow),
+                   "--dictionary-size is deprecated and ignored, the word "
+                   "count is read from the file\n");
+    }
+
+    std::vector<tpr::MixSource> sources;
+
+    for (const auto& value : program.get<std::vector<std::string>>("-d")) {
+        auto source = tpr::parse_mix_source(value);
 
-    const auto dictionary_path_value = program.get("-d");
+        if (not source) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "--dictionary = \"{}\", expected path[:weight] with "
+                       "a positive weight\n",
+                       value);
+            return 1;
+        }
+
+        sources.push_back(std::move(*source));
+    }
+
+    const auto& dictionary_path_value = sources.front().path;
     const std::filesystem::path dictionary_path(dictionary_path_value);
 
-    if (not std::filesystem::exists(dictionary_path)) {
+    const bool streamed = dictionary_path == "-";
+    const bool mixed = sources.size() > 1;
+
+    for (const auto& source : sources) {
+        if (mixed and source.path == "-") {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "--dictionary = '-' can not be mixed with other "
+                       "dictionaries\n");
+            return 1;
+        }
+
+        if (source.path != "-" and not std::filesystem::exists(source.path)) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "provided --dictionary-path = \"{}\", does not exist\n",
+                       source.path);
+            return 1;
+        }
+    }
+
+    const tpr::TestConfig config{
+        .amount = amount,
+        .top = top,
+        .min_length = min_length,
+        .max_length = max_length,
+        .weighted = program.get("--distribution") == "zipf",
+    };
+
+    const auto batch = program.present<uint64_t>("--batch");
+
+    std::optional<tpr::ServeAddress> serve;
+
+    if (const auto address = program.present("--serve")) {
+        serve = tpr::parse_serve_address(*address);
+
+        if (not serve) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "--serve = \"{}\", expected [host]:port\n", *address);
+            return 1;
+        }
+    }
+
+    const uint64_t seed = program.present<uint64_t>("--seed").value_or(
+        (uint64_t{std::random_device{}()} << 32) | std::random_device{}());
+
+    const auto engine = program.get("--engine");
+
+    const std::filesystem::path cache_directory(program.get("--cache-dir"));
+
+    tpr::TestOptions options{
+        .unit = program.get("--measure-units"),
+        .live = program.get<bool>("--live"),
+        .seed = seed,
+        .record = program.present("--record"),
+        .sync_every = program.get<uint32_t>("--sync-every"),
+        .adaptive = program.present("--adaptive"),
+        .export_path = export_path,
+        .export_format = export_format,
+        .threads = program.get<unsigned>("--threads"),
+    };
+
+    const auto finish = [profiled](int status) {
+        if (profiled and tpr::profile().enabled()) {
+            fmt::memory_buffer out;
+            tpr::render_profile(tpr::profile(), out);
+            tpr::flush(out, stderr);
+        }
+
+        return status;
+    };
+
+    const auto markov = program.present("--markov");
+    const auto compile_markov =
+        program.present<std::vector<std::string>>("--compile-markov");
+
+    if (mixed and (serve or options.adaptive or markov or compile_markov)) {
         fmt::print(fg(fmt::terminal_color::red),
-                   "provided --dictionary-path = \"{}\", does not exist\n",
-                   dictionary_path_value);
+                   "--serve, --adaptive and the Markov model take a single "
+                   "--dictionary\n");
         return 1;
     }
 
-    const auto filter_function = [&max_length, &min_length](const auto& word) {
-        return (word.size() <= max_length or not max_length) and
-               (word.size() >= min_length or not min_length);
-    };
+    if (markov and (serve or options.adaptive)) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "--markov can not be combined with --serve or "
+                   "--adaptive\n");
+        return 1;
+    }
 
-    auto rng = std::mt19937{std::random_device{}()};
+    if (export_path and (serve or batch)) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "--export takes the results of a typed test or --replay, "
+                   "not of --serve or --batch\n");
+        return 1;
+    }
 
-    tpr::read_dictionary<Char>(dictionary_path, dictionary_size, &resource)
-        .and_then([&](const auto& dictionary) {
-            namespace chr = std::chrono;
+    if (streamed and (markov or compile_markov)) {
+        fmt::print(fg(fmt::terminal_color::red),
+                   "a Markov model needs a --dictionary file, not stdin\n");
+        return 1;
+    }
 
-            auto filtered =                               //
-                dictionary                                //
-                | ranges::views::take(top)                //
-                | ranges::views::filter(filter_function)  //
-                | ranges::views::sample(amount, rng)      //
-                | ranges::views::join(' ')                //
-                | ranges::to<std::basic_string<Char>>();  //
+    if (compile_markov) {
+        const std::filesystem::path corpus((*compile_markov)[0]);
+        const std::filesystem::path output((*compile_markov)[1]);
 
-            std::pmr::basic_string<Char> buffer(&resource);
-            buffer.reserve(filtered.size());
+        const auto dictionary =
+            tpr::read_dictionary<Char>(dictionary_path, &resource);
+        const auto file = tpr::MappedFile::open(corpus);
 
-            fmt::print("{}\n", filtered);
+        if (not dictionary or not file) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not read file \"{}\"\n",
+                       (dictionary ? corpus : dictionary_path).string());
+            return 1;
+        }
 
-            Char c;
-            std::cin >> c;
-            const auto start_time = chr::high_resolution_clock::now();
-            std::getline(std::cin, buffer);
-            const auto end_time = chr::high_resolution_clock::now();
+        const auto model = tpr::build_markov_model(
+            *dictionary, file->view<Char>(), &resource);
 
-            const auto duration =
-                chr::duration_cast<chr::microseconds>(end_time - start_time)
-                    .count();
+        if (not tpr::compile_markov_model(model, output)) {
+            fmt::print(fg(fmt::terminal_color::red),
+                       "Error occured: Could not write file \"{}\"\n",
+                       output.string());
+            return 1;
+        }
 
-            size_t errors = 0;
+        return 0;
+    }
 
-            errors += tpr::report_error(filtered[0], c);
-            errors += filtered.size() > (buffer.size() + 1)
-                          ? filtered.size() - buffer.size() + 1
-                          : (buffer.size() + 1) - filtered.size();
+    if (mixed) {
+        return finish(tpr::run_mixed<Char>(sources, engine, config, batch,
+                                           program.get("--output"),
+                                           cache_directory, options,
+                                           &resource));
+    }
 
-            errors = std::ranges::fold_left(
-                ranges::views::zip(filtered | ranges::views::drop(1), buffer),
-                errors, [](size_t errors, const auto& element) -> size_t {
-                    return errors +
-                           tpr::report_error(element.first, element.second);
-                });
+    // Tests and batches of a single dictionary never see more than its
+    // `top` words, so only those are read and indexed, and the index cache
+    // is skipped since it hashes the whole file. Served requests choose
+    // their own `top`, adaptive tests and Markov models need every word.
+    const bool prefix = top and not(serve or options.adaptive or markov);
 
-            fmt::println("\nErros: {}", errors);
+    // A served generator is freed once a reload replaced it and its last
+    // request finished, so like the reloaded ones it is allocated from the
+    // default resource. `resource` would keep it until exit.
+    auto* const generator_resource =
+        serve ? std::pmr::get_default_resource()
+              : static_cast<std::pmr::memory_resource*>(&resource);
 
-            fmt::print(fg(fmt::terminal_color::yellow), "You were typing: {}",
-                       duration);
+    const auto read = [&] {
+        return streamed ? tpr::read_dictionary_stream<Char>(
+                              stdin, config, seed, generator_resource)
+                        : tpr::read_dictionary<Char>(
+                              dictionary_path, generator_resource,
+                              program.get<unsigned>("--threads"),
+                              prefix ? top : 0);
+    };
 
-            return std::make_optional(dictionary);
-        })
-        .or_else([&dictionary_path, &resource] {
-            fmt::print("Error occured: Could not read file \"{}\"",
-                       dictionary_path.string());
+    const int status =
+        read()
+            .transform([&](auto&& dictionary) {
+                return tpr::with_engine(engine, [&]<class Engine>(
+                                                    std::type_identity<
+                                                        Engine>) {
+                    const auto cache =
+                        prefix ? std::nullopt
+                               : tpr::IndexCache::open(cache_directory,
+                                                       dictionary_path,
+                                                       dictionary.file());
+                    options.cache = cache ? &*cache : nullptr;
 
-            return std::make_optional(Strings(&resource));
-        });
+                    // checked once, the rest is specialized on it
+                    const bool ascii = tpr::is_ascii(dictionary.text());
 
-    return 0;
+                    if (markov) {
+                        return tpr::run_markov<Char, Engine>(
+                            std::move(dictionary), ascii, *markov, config,
+                            batch, program.get("--output"), options,
+                            &resource);
+                    }
+
+                    auto index =
+                        ascii ? tpr::cached_length_index<tpr::Ascii>(
+                                    options.cache, dictionary,
+                                    generator_resource)
+                              : tpr::cached_length_index<tpr::Utf8>(
+                                    options.cache, dictionary,
+                                    generator_resource);
+
+                    tpr::TestGenerator<Char, Engine> generator(
+                        std::move(dictionary), std::move(index), seed,
+                        generator_resource);
+
+                    if (batch) {
+                        return tpr::run_batch(
+                            generator, config, *batch,
+                            program.get<unsigned>("--threads"), seed,
+                            program.get("--output"));
+                    }
+
+                    if (serve) {
+                        return tpr::run_serve(
+                            std::move(generator), config, *serve, options,
+                            streamed ? std::nullopt
+                                     : std::optional(dictionary_path),
+                            cache_directory);
+                    }
+
+                    if (streamed and not tpr::reopen_terminal_input()) {
+                        fmt::print(fg(fmt::terminal_color::red),
+                                   "Error occured: No terminal to type the "
+                                   "test in after reading words from "
+                                   "stdin\n");
+                        return 1;
+                    }
+
+                    return ascii ? tpr::run_test<tpr::Ascii>(generator, config,
+                                                             options)
+                                 : tpr::run_test<tpr::Utf8>(generator, config,
+                                                            options);
+                });
+            })
+            .or_else([&dictionary_path] {
+                fmt::print("Error occured: Could not read file \"{}\"",
+                           dictionary_path.string());
+
+                return std::optional<int>{1};
+            })
+            .value();
+
+    return finish(status);
 }